@@ -0,0 +1,364 @@
+#define _GNU_SOURCE // mkstemp, setenv
+#include "../include/arena.h"
+#include "../include/astcache.h"
+#include "../include/complete.h"
+#include "../include/history.h"
+#include "../include/jobs.h"
+#include "../include/parser.h"
+#include "../include/shell.h"
+#include "../include/vars.h"
+#include <time.h>
+
+// Microbenchmarks for the shell internals. Each benchmark takes a number of
+// timed samples; a sample runs the operation ops_per_sample times and
+// records the mean cost per operation. Results are written as JSON with
+// percentiles over the samples:
+//
+//   bench.out [-o FILE] [-s SCALE] [NAME-PREFIX...]
+//
+// SCALE multiplies the sample counts (default 1).
+
+typedef struct {
+  const char *name;
+  int samples;        // Timed samples taken
+  int ops_per_sample; // Operations per sample
+  void (*setup)(void);
+  void (*run)(int ops);
+  void (*teardown)(void);
+} Benchmark;
+
+// Realistic interactive command lines, from trivial to heavy
+static const char *parse_lines[] = {
+    "ls",
+    "reveal -la ~",
+    "hop .. ; reveal -l",
+    "cat README.md | grep -i shell | sort | uniq -c > out.txt",
+    "make -j8 CFLAGS=-O2 >> build.log ; echo done &",
+    "find . -name '*.c' | xargs grep -n TODO | head -n 20 < /dev/null",
+    "sleep 10 & ; sleep 20 & ; activities ; ping 1 9",
+    "log -f git ; log ; hop - ; reveal -a -l /usr/include ; echo a b c d e "
+    "f g h i j k l m n o p q r s t u v w x y z",
+};
+#define PARSE_LINE_COUNT (sizeof(parse_lines) / sizeof(parse_lines[0]))
+
+static Arena bench_arena;
+static char history_path[] = "/tmp/shell-bench-history-XXXXXX";
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// --- parse_input ---
+
+static void parse_setup(void) { arena_init(&bench_arena); }
+
+static void parse_run(int ops) {
+  for (int i = 0; i < ops; i++) {
+    ASTNode *ast =
+        parse_input(&bench_arena, parse_lines[i % PARSE_LINE_COUNT]);
+    if (!ast)
+      abort();
+    arena_reset(&bench_arena);
+  }
+}
+
+static void parse_teardown(void) { arena_free(&bench_arena); }
+
+// The same lines again, served from the AST cache after the first round
+static void parse_cached_run(int ops) {
+  for (int i = 0; i < ops; i++) {
+    ASTNode *ast = ast_cache_get(parse_lines[i % PARSE_LINE_COUNT]);
+    if (!ast)
+      abort();
+    ast_cache_release(ast);
+  }
+}
+
+// --- Job table ---
+
+#define JOB_TABLE_SIZE 10000
+// Fake pgids: nothing is signalled or waited for
+#define JOB_PGID_BASE 1000000
+
+static void jobs_fill(void) {
+  for (int i = 0; i < JOB_TABLE_SIZE; i++) {
+    pid_t pgid = JOB_PGID_BASE + i;
+    add_job(pgid, "sleep 100", 1, &pgid, 1);
+  }
+}
+
+static void jobs_empty(void) {
+  for (int i = 0; i < JOB_TABLE_SIZE; i++)
+    remove_job(JOB_PGID_BASE + i);
+}
+
+// Add and remove one job on top of a full table
+static void jobs_add_remove_run(int ops) {
+  pid_t pgid = JOB_PGID_BASE - 1;
+  for (int i = 0; i < ops; i++) {
+    add_job(pgid, "sleep 100", 1, &pgid, 1);
+    remove_job(pgid);
+  }
+}
+
+static void jobs_lookup_run(int ops) {
+  unsigned x = 12345;
+  for (int i = 0; i < ops; i++) {
+    x = x * 1103515245 + 12345;
+    if (!get_job_by_pgid(JOB_PGID_BASE + (x >> 8) % JOB_TABLE_SIZE))
+      abort();
+  }
+}
+
+// Build and tear down a whole table of JOB_TABLE_SIZE jobs
+static void jobs_churn_run(int ops) {
+  for (int i = 0; i < ops; i++) {
+    jobs_fill();
+    jobs_empty();
+  }
+}
+
+// --- History ---
+
+static void history_setup(void) {
+  int fd = mkstemp(history_path);
+  if (fd < 0) {
+    perror("mkstemp");
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  setenv("HISTFILE", history_path, 1);
+  init_history();
+}
+
+static void history_run(int ops) {
+  char line[64];
+  static unsigned n;
+  for (int i = 0; i < ops; i++) {
+    snprintf(line, sizeof(line), "echo history entry %u", n++);
+    add_to_history(line);
+  }
+}
+
+static void history_teardown(void) { unlink(history_path); }
+
+// --- Launching ---
+
+static void execute_line(const char *line) {
+  ASTNode *ast = parse_input(&bench_arena, line);
+  if (!ast)
+    abort();
+  execute_ast(ast);
+  arena_reset(&bench_arena);
+}
+
+static void true_run(int ops) {
+  for (int i = 0; i < ops; i++)
+    execute_line("/bin/true");
+}
+
+// A prefix assignment: the shared envp plus one entry
+static void true_assign_run(int ops) {
+  for (int i = 0; i < ops; i++)
+    execute_line("BENCH=1 /bin/true");
+}
+
+static void pipe2_run(int ops) {
+  for (int i = 0; i < ops; i++)
+    execute_line("/bin/true | /bin/true");
+}
+
+// A builtin feeding an external command
+static void builtin_pipe_run(int ops) {
+  for (int i = 0; i < ops; i++)
+    execute_line("activities | /bin/true");
+}
+
+static void pipe8_run(int ops) {
+  for (int i = 0; i < ops; i++)
+    execute_line("/bin/true | /bin/true | /bin/true | /bin/true | "
+                 "/bin/true | /bin/true | /bin/true | /bin/true");
+}
+
+// --- Tab completion ---
+
+static const char *command_prefixes[] = {"g", "py", "ls", "ma", "x", "re"};
+#define COMMAND_PREFIX_COUNT                                                   \
+  (sizeof(command_prefixes) / sizeof(command_prefixes[0]))
+
+static const char *file_prefixes[] = {"/usr/include/s", "/usr/include/",
+                                      "/usr/bin/py", "/etc/"};
+#define FILE_PREFIX_COUNT (sizeof(file_prefixes) / sizeof(file_prefixes[0]))
+
+static void complete_one(const char *word, int command_position) {
+  Completion c;
+  if (complete_word(word, strlen(word), command_position, &c) != 0)
+    abort();
+  completion_free(&c);
+}
+
+// First use builds the $PATH trie and reads the listings; the timed runs
+// only revalidate them
+static void complete_setup(void) {
+  for (size_t i = 0; i < FILE_PREFIX_COUNT; i++)
+    complete_one(file_prefixes[i], 0);
+  complete_one("", 1);
+}
+
+static void complete_command_run(int ops) {
+  for (int i = 0; i < ops; i++)
+    complete_one(command_prefixes[i % COMMAND_PREFIX_COUNT], 1);
+}
+
+static void complete_file_run(int ops) {
+  for (int i = 0; i < ops; i++)
+    complete_one(file_prefixes[i % FILE_PREFIX_COUNT], 0);
+}
+
+// --- Variables ---
+
+// Expanding a cached tree's words, as done before every run
+static void expand_run(int ops) {
+  ASTNode *ast = ast_cache_get("ls -l $HOME ${PWD}/src $? | grep $USER");
+  if (!ast)
+    abort();
+  CommandNode *stage = (CommandNode *)((PipeNode *)ast)->left;
+  for (int i = 0; i < ops; i++) {
+    if (!vars_expand_command(&bench_arena, stage))
+      abort();
+    arena_reset(&bench_arena);
+  }
+  ast_cache_release(ast);
+}
+
+static const Benchmark benchmarks[] = {
+    {"parse_input", 2000, 64, parse_setup, parse_run, parse_teardown},
+    {"parse_cached", 2000, 64, NULL, parse_cached_run, ast_cache_clear},
+    {"jobs_add_remove", 2000, 64, jobs_fill, jobs_add_remove_run,
+     jobs_empty},
+    {"jobs_lookup", 2000, 256, jobs_fill, jobs_lookup_run, jobs_empty},
+    {"jobs_churn_10k", 50, 1, NULL, jobs_churn_run, NULL},
+    {"add_to_history", 2000, 16, history_setup, history_run,
+     history_teardown},
+    {"execute_true", 300, 1, parse_setup, true_run, parse_teardown},
+    {"execute_pipe2", 200, 1, parse_setup, pipe2_run, parse_teardown},
+    {"execute_pipe8", 100, 1, parse_setup, pipe8_run, parse_teardown},
+    {"execute_builtin_pipe", 200, 1, parse_setup, builtin_pipe_run,
+     parse_teardown},
+    {"complete_command", 2000, 64, complete_setup, complete_command_run,
+     NULL},
+    {"complete_file", 2000, 64, complete_setup, complete_file_run,
+     complete_invalidate_dirs},
+    {"expand_command", 2000, 64, parse_setup, expand_run, parse_teardown},
+    {"execute_true_assign", 300, 1, parse_setup, true_assign_run,
+     parse_teardown},
+};
+#define BENCHMARK_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile of sorted samples
+static double percentile(const double *sorted, int n, double p) {
+  int rank = (int)(p / 100.0 * n + 0.5);
+  if (rank < 1)
+    rank = 1;
+  if (rank > n)
+    rank = n;
+  return sorted[rank - 1];
+}
+
+static void run_benchmark(const Benchmark *b, int scale, FILE *out,
+                          int first) {
+  int n = b->samples * scale;
+  double *samples = malloc(n * sizeof(*samples));
+  if (!samples) {
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+
+  if (b->setup)
+    b->setup();
+  b->run(b->ops_per_sample); // Warm up caches and lazy initialization
+  double total = 0;
+  for (int i = 0; i < n; i++) {
+    double start = now_ns();
+    b->run(b->ops_per_sample);
+    samples[i] = (now_ns() - start) / b->ops_per_sample;
+    total += samples[i];
+  }
+  if (b->teardown)
+    b->teardown();
+
+  qsort(samples, n, sizeof(*samples), compare_doubles);
+  fprintf(out,
+          "%s    {\"name\": \"%s\", \"samples\": %d, \"ops_per_sample\": %d, "
+          "\"unit\": \"ns/op\", \"min\": %.1f, \"p50\": %.1f, \"p90\": "
+          "%.1f, \"p99\": %.1f, \"max\": %.1f, \"mean\": %.1f}",
+          first ? "" : ",\n", b->name, n, b->ops_per_sample, samples[0],
+          percentile(samples, n, 50), percentile(samples, n, 90),
+          percentile(samples, n, 99), samples[n - 1], total / n);
+  fprintf(stderr, "%-16s p50 %12.1f ns/op\n", b->name,
+          percentile(samples, n, 50));
+  free(samples);
+}
+
+static int selected(const char *name, char **filters, int count) {
+  if (count == 0)
+    return 1;
+  for (int i = 0; i < count; i++) {
+    if (strncmp(name, filters[i], strlen(filters[i])) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *out_path = NULL;
+  int scale = 1;
+  int argi = 1;
+
+  for (; argi < argc && argv[argi][0] == '-'; argi++) {
+    if (strcmp(argv[argi], "-o") == 0 && argi + 1 < argc) {
+      out_path = argv[++argi];
+    } else if (strcmp(argv[argi], "-s") == 0 && argi + 1 < argc) {
+      scale = atoi(argv[++argi]);
+      if (scale < 1)
+        scale = 1;
+    } else {
+      fprintf(stderr, "Usage: %s [-o FILE] [-s SCALE] [NAME-PREFIX...]\n",
+              argv[0]);
+      return 2;
+    }
+  }
+
+  FILE *out = stdout;
+  if (out_path && !(out = fopen(out_path, "w"))) {
+    perror(out_path);
+    return EXIT_FAILURE;
+  }
+
+  if (getcwd(g_shell_home_dir, sizeof(g_shell_home_dir)) == NULL) {
+    perror("getcwd");
+    return EXIT_FAILURE;
+  }
+  init_jobs();
+
+  fprintf(out, "{\n  \"benchmarks\": [\n");
+  int first = 1;
+  for (size_t i = 0; i < BENCHMARK_COUNT; i++) {
+    if (!selected(benchmarks[i].name, argv + argi, argc - argi))
+      continue;
+    run_benchmark(&benchmarks[i], scale, out, first);
+    first = 0;
+  }
+  fprintf(out, "\n  ]\n}\n");
+
+  if (out != stdout)
+    fclose(out);
+  return EXIT_SUCCESS;
+}
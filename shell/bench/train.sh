@@ -0,0 +1,18 @@
+# Training workload for `make PROFILE=pgo`, run as a batch script.
+# Covers the interactive paths the microbenchmarks do not: reveal, hop,
+# job listing and pipelines mixing builtins with external commands.
+reveal -a -l /usr/include
+reveal -a /usr/bin
+reveal -l /etc
+hop /tmp ; reveal -a ; hop - ; hop ~ ; hop -
+echo one two three | tr a-z A-Z | sort -r | uniq
+cat /etc/passwd | grep -v nologin | head -n 5 > /dev/null
+ping 1 0 ; hash -s ; hash ; launcher
+sleep 0.05 & ; sleep 0.05 & ; activities
+launcher fork
+echo forked | cat ; /bin/true ; reveal -l /usr/bin > /dev/null
+launcher spawn
+log | head -n 3 ; activities | wc -l
+dir=/usr/include ; reveal -l $dir > /dev/null ; export dir
+LC_ALL=C sort /etc/passwd | head -n 2 > /dev/null ; echo $? ${dir}/sys
+sleep 0.1
@@ -0,0 +1,37 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Bump allocator. Allocations are carved out of a chain of chunks and are
+// released all at once by arena_reset, which keeps the chunks for reuse.
+typedef struct ArenaChunk {
+  struct ArenaChunk *next;
+  size_t size;
+  size_t used;
+  char data[];
+} ArenaChunk;
+
+typedef struct {
+  ArenaChunk *head;
+  ArenaChunk *current;
+} Arena;
+
+void arena_init(Arena *arena);
+
+// Returns uninitialized memory aligned for any object type, or NULL.
+void *arena_alloc(Arena *arena, size_t size);
+
+// Same as arena_alloc, but zero-filled.
+void *arena_calloc(Arena *arena, size_t count, size_t size);
+
+// Copy n bytes of s into the arena and NUL-terminate the copy.
+char *arena_strndup(Arena *arena, const char *s, size_t n);
+
+// Forget every allocation in O(1); the chunks stay allocated.
+void arena_reset(Arena *arena);
+
+// Release all chunks back to malloc.
+void arena_free(Arena *arena);
+
+#endif // ARENA_H
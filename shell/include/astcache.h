@@ -0,0 +1,28 @@
+#ifndef ASTCACHE_H
+#define ASTCACHE_H
+
+#include "parser.h"
+
+// Small LRU cache of parsed command lines, keyed by the exact line text.
+// Each entry owns an arena holding its copy of the line and the tree, so a
+// repeated line is executed without being tokenized or parsed again.
+// Cached trees are shared and must not be modified.
+
+#define AST_CACHE_SIZE 32
+
+// Returns the tree for line, parsing and caching it on a miss. Returns
+// NULL on a syntax error; those lines are not cached. The tree is pinned
+// until it is passed to ast_cache_release: neither eviction nor
+// ast_cache_clear frees it while it runs.
+ASTNode *ast_cache_get(const char *line);
+void ast_cache_release(ASTNode *ast);
+
+// Drop every cached tree. With a tree pinned, the cache is cleared when
+// the last one is released.
+void ast_cache_clear(void);
+
+// Lookup counters since startup and the number of cached lines.
+void ast_cache_stats(unsigned long *hits, unsigned long *misses,
+                     size_t *entries);
+
+#endif // ASTCACHE_H
@@ -0,0 +1,42 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include "shell.h"
+
+// Tab completion data. Command names come from a prefix trie over every
+// executable on $PATH plus the built-ins; it is built on first use and
+// rebuilt only when $PATH or the mtime of one of its directories changes.
+// File names come from sorted directory listings, cached per directory
+// and revalidated by mtime. hop drops the listings, since relative
+// directories mean something else afterwards.
+
+typedef struct {
+  size_t count; // Number of matches
+  char *common; // Longest prefix of every match, malloc'ed
+  int is_dir;   // The only match is a directory
+
+  // Where the matches are, for completion_each
+  int trie_node;   // Trie subtree ending in common, or -1
+  const void *dir; // Otherwise a range of a directory listing
+  size_t first, end;
+  int skip_hidden;
+} Completion;
+
+// Complete word, the len bytes before the cursor. In command position a
+// word without '/' is matched against command names, anything else
+// against the files of its directory; matches and common are then the
+// part after the last '/'. Returns 0, or -1 if nothing could be read.
+int complete_word(const char *word, size_t len, int command_position,
+                  Completion *c);
+
+// Call fn on every match of c, in sorted order. Valid until the next
+// complete_word call.
+void completion_each(const Completion *c,
+                     void (*fn)(const char *name, void *arg), void *arg);
+
+void completion_free(Completion *c);
+
+// Forget the cached directory listings
+void complete_invalidate_dirs(void);
+
+#endif // COMPLETE_H
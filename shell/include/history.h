@@ -0,0 +1,32 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "shell.h"
+
+// Command history. Every entry is appended to an on-disk history file
+// ($HISTFILE, default ~/.shell_history) as it is added. The file is mapped
+// at startup and only indexed the first time the history is read. In
+// memory the last $HISTSIZE entries (default MAX_HISTORY) are kept
+// back-to-back in one byte buffer with an offset index.
+
+void init_history(void);
+void add_to_history(const char *command);
+void clear_history(void);
+void display_history(void);
+int save_history(const char *filename);
+
+// Print every entry containing pattern. Returns the number of matches. A
+// history not read yet is searched in the mapped file, without loading it.
+size_t search_history(const char *pattern);
+
+// Number of entries, and entry n counted from 1 (NULL if out of range)
+size_t history_length(void);
+const char *history_entry(size_t n);
+
+// History expansion: `!!` is the newest entry, `!n` entry n and `!-n` the
+// n-th newest. Returns 1 and a malloc'ed line in *expanded if anything was
+// substituted, 0 if line has no references, and -1 (after printing an
+// error) if an entry does not exist.
+int expand_history(const char *line, char **expanded);
+
+#endif // HISTORY_H
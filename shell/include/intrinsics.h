@@ -16,6 +16,33 @@ typedef struct {
 // Main handler to find and execute a built-in
 int handle_builtin(CommandNode *cmd);
 
+// Returns 1 if name refers to a built-in command
+int is_builtin(const char *name);
+
+// Name of built-in i, or NULL past the last one
+const char *builtin_name(int i);
+
+// Returns 1 if cmd, with its input on in_fd, is run by a built-in. cat
+// leaves options to the external command, and a terminal too, since only a
+// process of its own can be interrupted or stopped from the keyboard.
+int runs_as_builtin(CommandNode *cmd, int in_fd);
+
+// Returns 1 if cat is given an option, or would read its input from a
+// terminal on in_fd
+int cat_needs_external(CommandNode *cmd, int in_fd);
+
+// Returns 1 for built-ins that change the shell's own state
+int is_parent_builtin(const char *cmd_name);
+
+// Returns 1 for built-ins that copy data for as long as their input lasts
+// (cat, parallel). Blocked on a pipe they would hold up the shell.
+int is_streaming_builtin(const char *cmd_name);
+
+// Returns 1 for built-ins that start and wait for processes of their own
+// (parallel). They always get a forked child, so Ctrl-Z stops them along
+// with those processes and the shell gets the prompt back.
+int needs_own_process(const char *cmd_name);
+
 // Built-in command implementations
 int builtin_hop(char **args);
 int builtin_reveal(char **args);
@@ -25,12 +52,15 @@ int builtin_activities(char **args);
 int builtin_fg(char **args);
 int builtin_bg(char **args);
 int builtin_exit(char **args); // New function
-
-// History management functions
-void init_history(void);
-void add_to_history(const char *command);
-void clear_history(void);
-void display_history(void);
-int save_history(const char *filename);
+int builtin_hash(char **args);
+int builtin_launcher(char **args);
+int builtin_parsecache(char **args);
+int builtin_parallel(char **args);
+int builtin_bglimit(char **args);
+int builtin_wait(char **args);
+int builtin_pipestatus(char **args);
+int builtin_cat(char **args);
+int builtin_export(char **args);
+int builtin_unset(char **args);
 
 #endif // INTRINSICS_H
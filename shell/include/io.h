@@ -6,4 +6,35 @@
 // Function to display the shell prompt
 void display_prompt(void);
 
+// The prompt as display_prompt writes it, and its length
+const char *prompt_text(size_t *len);
+
+// Drop the cached prompt; call after the working directory changes
+void invalidate_prompt(void);
+
+// Where the shell reads command lines from: a stdio stream (stdin), or a
+// script file / -c string held in memory
+typedef struct LineSource {
+  FILE *stream;
+  const char *data; // In-memory input, or NULL for a stream
+  size_t len;
+  size_t pos;
+  int mapped; // data is an mmap of a script file
+  char *line; // Current line, NUL-terminated without the newline
+  size_t line_cap;
+  int edit;           // Read the terminal through the line editor
+  const char *prompt; // Editor prompt, NULL for the shell prompt
+} LineSource;
+
+void line_source_from_stream(LineSource *src, FILE *stream);
+void line_source_from_string(LineSource *src, const char *str);
+// Map a script file. Returns -1 (errno set) if it cannot be opened.
+int line_source_from_file(LineSource *src, const char *path);
+void line_source_close(LineSource *src);
+
+// Read the next line into src->line. Returns its length, or -1 at EOF.
+// With edit set the editor draws the prompt itself and reports finished
+// background jobs while it waits.
+ssize_t line_source_next(LineSource *src);
+
 #endif // IO_H
@@ -3,33 +3,137 @@
 
 #include "parser.h"
 #include "shell.h"
+#include <sys/resource.h>
+#include <time.h>
 
 // Enum for job status
-typedef enum { JOB_RUNNING, JOB_STOPPED, JOB_DONE } JobStatus;
+typedef enum { JOB_RUNNING, JOB_STOPPED, JOB_DONE, JOB_QUEUED } JobStatus;
 
-// Struct to represent a job
+// One process of a job
 typedef struct {
+  pid_t pid;
+  int reaped;          // Exited and waited for
+  int status;          // Raw wait status once reaped
+  struct rusage usage; // Valid once reaped
+} JobProcess;
+
+// Struct to represent a job
+typedef struct Job {
   pid_t pgid;
   int job_id;
   JobStatus status;
   char *command;
   int is_background;
+  int wait_status; // Raw wait status of the group leader once done
+  int notify;      // State changed and not yet reported to the user
+  struct rusage usage; // Summed over the processes reaped so far
+  struct timespec start; // CLOCK_MONOTONIC time the job was started
+  JobProcess *procs;     // Every process of the job, in pipeline order
+  int proc_count;
+
+  // A queued job has no processes yet (pgid 0) and keeps a copy of its
+  // pipeline until a background slot frees up
+  Arena arena;
+  CommandNode **stages;
+  int stage_count;
+  struct Job *queue_next;
+
+  // Job table links, maintained by jobs.c
+  struct Job *prev, *next;               // All jobs in job id order
+  struct Job *id_chain, *pgid_chain;     // Hash bucket chains
+  struct Job *notify_prev, *notify_next; // Unreported state changes
 } Job;
 
-// Job table
-extern Job job_table[MAX_JOBS];
+// Job table. Jobs live in slabs that never move, so Job pointers stay
+// valid until the job is removed.
 extern int next_job_id;
 
+// Most background jobs allowed to run at once, 0 for no limit. Jobs put in
+// the background beyond it are queued and started in order as running
+// ones finish.
+extern int g_bg_limit;
+
 // Job management functions
 void init_jobs(void);
-int add_job(pid_t pgid, const char *command, int is_background);
+int add_job(pid_t pgid, const char *command, int is_background,
+            const pid_t *pids, int pid_count);
 void remove_job(pid_t pgid);
 Job *get_job_by_id(int job_id);
 Job *get_job_by_pgid(pid_t pgid);
+void delete_job(Job *job);
+
+// Oldest job; follow job->next for the rest in job id order
+Job *first_job(void);
+
+// Change status and is_background together. Jobs are only changed through
+// here, so the count of running background jobs checked against the
+// background limit never needs a walk of the table.
+void set_job_state(Job *job, JobStatus status, int is_background);
 void update_job_status(pid_t pgid, int status);
-void check_background_jobs(void);
+
+// Move a job to another process group, keeping the pgid index current
+void set_job_pgid(Job *job, pid_t pgid);
+
+// Record one more process of a running job, reusing the slot of a reaped
+// one. Returns 0 on success.
+int job_add_process(Job *job, pid_t pid);
+
+// Block until a live process of job exits or stops and return its pid,
+// with the wait status in *status. Other children that change state
+// meanwhile are recorded as usual. Returns -1 once nothing is left.
+pid_t wait_job_process(Job *job, int *status);
+
+// Start queued jobs while the background limit allows
+void start_queued_jobs(void);
+
+// Take a job off the queue and start it now, whatever the limit
+void start_queued_job(Job *job);
+
+// Wait for running jobs to finish until the queue is empty, so nothing
+// queued is lost when the shell reaches the end of its input
+void drain_job_queue(void);
+
+// Block in the kernel until job is done, or with job NULL until any
+// background job is. Returns 0 with the finished job, still in the table,
+// in *done; 1 if there is nothing (left) to wait for; -1 on Ctrl-C.
+int wait_background(Job *job, Job **done);
+
+// Exit status of a finished job, $? style
+int job_exit_status(const Job *job);
+
+// Exit statuses of the stages of the last foreground pipeline, like
+// PIPESTATUS in bash. Returns the number of stages.
+int get_pipestatus(const int **codes);
+
+// Resource figures of one process at the time of the call
+typedef struct {
+  char state;         // /proc state letter; 'X' once reaped, '?' unknown
+  char name[16];      // Command name, empty once reaped
+  double cpu_seconds; // User plus system time
+  long rss_kib;       // Current RSS, or peak RSS once reaped
+} ProcessSample;
+
+// Read a live process from /proc/<pid>/stat, or take the rusage recorded
+// when it was reaped. Returns 0 on success.
+int sample_process(const JobProcess *proc, ProcessSample *out);
+
+// Reap children that changed state since the last SIGCHLD and update the
+// job table. Costs nothing when no SIGCHLD has arrived. Returns the number
+// of job changes waiting to be reported.
+int handle_sigchld_events(void);
+
+// Report finished and stopped background jobs, dropping finished ones.
+// Returns the number of lines printed.
+int notify_job_changes(void);
 void print_job_status(Job *job, int is_bg_completion);
 
+// Both of the above, as done before every prompt
+void check_background_jobs(void);
+
+// Give the terminal to a job and wait until all of its processes have
+// exited (the job is removed) or it stops.
+void wait_for_job(Job *job);
+
 // Execution functions
 void execute_ast(ASTNode *node);
 
@@ -0,0 +1,32 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include "parser.h"
+#include "shell.h"
+
+// Backend used to start external commands
+typedef enum { LAUNCH_FORK, LAUNCH_SPAWN } LaunchMode;
+
+extern LaunchMode g_launch_mode;
+
+// Open the file behind a redirection (close-on-exec). Prints a diagnostic
+// and returns -1 on failure.
+int open_redirection(const Redirection *r);
+
+// Child side of fork(): join the process group, restore default signal
+// dispositions, wire up fds and exec (or run a built-in). Never returns.
+void launch_process(CommandNode *cmd, const char *path, pid_t pgid,
+                    int is_background, int in_fd, int out_fd, int is_pipe);
+
+// Start an external command with posix_spawn without duplicating the
+// shell's address space. pgid == 0 puts the child in a new process group.
+// Returns the child's pid, or -1 if it could not be started.
+pid_t spawn_process(CommandNode *cmd, const char *path, pid_t pgid,
+                    int is_background, int in_fd, int out_fd);
+
+// Run a built-in inside the shell with stdin and stdout pointed at in_fd
+// and out_fd and its redirections applied. The shell's own descriptors are
+// restored afterwards. Returns the built-in's status.
+int run_builtin_in_shell(CommandNode *cmd, int in_fd, int out_fd);
+
+#endif // LAUNCH_H
@@ -0,0 +1,16 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include "shell.h"
+
+// Line editor for interactive input. The terminal is put in raw mode for
+// the length of one line: cursor movement, history recall with the arrow
+// keys, the usual Emacs control keys and tab completion of command and
+// file names. Ctrl-C drops the line, Ctrl-D on an empty line is EOF.
+//
+// Draws prompt, then reads one line from stdin into *line (grown as
+// needed, NUL-terminated). Returns its length, or -1 at EOF.
+ssize_t line_edit(const char *prompt, size_t prompt_len, char **line,
+                  size_t *cap);
+
+#endif // LINEEDIT_H
@@ -1,6 +1,7 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include "arena.h"
 #include "shell.h"
 
 // Enum for AST node types
@@ -8,6 +9,7 @@ typedef enum {
   NODE_COMMAND,
   NODE_PIPE,
   NODE_SEQUENCE,
+  NODE_TIME,
 } NodeType;
 
 // Enum for redirection types
@@ -27,7 +29,9 @@ typedef struct ASTNode {
 // Struct for a redirection
 typedef struct Redirection {
   RedirType type;
-  char *filename;
+  char *filename; // Target file, or the delimiter of a here-document
+  char *body;     // Here-document text, filled in after parsing
+  size_t body_len;
   struct Redirection *next;
 } Redirection;
 
@@ -36,8 +40,11 @@ typedef struct {
   NodeType type;
   char **args;
   int arg_count;
+  char **assigns; // Leading NAME=value words, NULL-terminated
+  int assign_count;
   Redirection *redirections;
   int background; // 1 if background (&), 0 otherwise
+  int expand;     // Some word refers to a variable ('$')
 } CommandNode;
 
 // AST node for a pipe
@@ -54,8 +61,16 @@ typedef struct {
   ASTNode *right;
 } SequenceNode;
 
+// AST node for `time pipeline`
+typedef struct {
+  NodeType type;
+  ASTNode *body; // NULL for a bare `time`
+} TimeNode;
+
 // Function prototypes
-ASTNode *parse_input(const char *input);
-void free_ast(ASTNode *node);
+
+// Parse one input line. Every node, argv array and string of the tree is
+// allocated from arena, so the tree is released by resetting the arena.
+ASTNode *parse_input(Arena *arena, const char *input);
 
 #endif // PARSER_H
@@ -0,0 +1,29 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+#include "shell.h"
+
+// Resolved-path cache for external commands (the `hash` table).
+// Entries map a bare command name to the absolute path found on $PATH.
+// The table is dropped whenever $PATH changes, and an entry is dropped
+// when its file is no longer executable.
+
+// Returns the cached absolute path for name, resolving and caching it on a
+// miss. Returns NULL for names containing '/', for names not on $PATH and
+// for names that are not before every relative $PATH element; execvp has
+// to search for those.
+const char *path_cache_lookup(const char *name);
+
+// Resolve name and insert it into the cache. Returns 0 on success.
+int path_cache_add(const char *name);
+
+// Drop every cached entry.
+void path_cache_clear(void);
+
+// Print cached entries with their hit counts.
+void path_cache_print(void);
+
+// Lookup counters since startup.
+void path_cache_stats(unsigned long *hits, unsigned long *misses);
+
+#endif // PATHCACHE_H
@@ -15,21 +15,27 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
-#define MAX_INPUT_SIZE 1024
 #define MAX_ARGS 64
-#define MAX_JOBS 64
 #define MAX_HISTORY 100
 
-// Main shell loop
-void shell_loop(void);
+struct LineSource;
+
+// Main shell loop: read lines from src until EOF
+void shell_loop(struct LineSource *src);
 
 // Signal handlers
 void sigint_handler(int sig);
 void sigtstp_handler(int sig);
+void sigchld_handler(int sig);
 
 // Global variables
 extern pid_t g_fg_pgid;
 extern char
     g_shell_home_dir[PATH_MAX]; // The directory where the shell was started
+extern int g_sigchld_pipe[2];   // Self-pipe written on every SIGCHLD
+extern volatile sig_atomic_t g_sigchld_pending;
+extern volatile sig_atomic_t g_sigint_received; // Set on every SIGINT
+extern int g_interactive; // Reading commands from a terminal
+extern int g_last_status; // Exit status of the last command
 
 #endif // SHELL_H
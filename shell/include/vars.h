@@ -0,0 +1,56 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include "arena.h"
+#include "parser.h"
+#include "shell.h"
+
+// Shell variables, kept in a hash table. The startup environment is
+// imported as exported variables on first use. Every exported variable
+// owns one "NAME=value" string, and those strings make up the envp handed
+// to new processes. Setting, exporting or unsetting a variable patches
+// that array in place, so launches reuse it without rebuilding it.
+
+// Value of name, or NULL if it is not set
+const char *vars_get(const char *name);
+
+// Export name, setting it to value first unless value is NULL. Exporting
+// an unset variable without a value does nothing. Returns 0 or -1.
+int vars_export(const char *name, const char *value);
+
+void vars_unset(const char *name);
+
+// Apply a "NAME=value" word; an exported variable stays exported, and
+// export exports it. Returns 0, or -1 if the word is not an assignment.
+int vars_assign(const char *assignment, int export);
+
+// Length of NAME if word starts with "NAME=", otherwise 0
+size_t vars_assignment_name(const char *word, size_t len);
+
+// The environment for new processes, NULL-terminated. Valid until the next
+// change to an exported variable.
+char **vars_environ(void);
+
+// The environment with count "NAME=value" words layered on top, for a
+// command with prefix assignments. The array is malloc'ed (the strings are
+// not copied); release it with free().
+char **vars_environ_with(char **assigns, int count);
+
+// Export count "NAME=value" words for the length of one command. Returns
+// what vars_restore needs to put the old values back.
+typedef struct VarSave VarSave;
+VarSave *vars_apply(char **assigns, int count);
+void vars_restore(VarSave *save);
+
+// Print every exported variable as `export NAME=value`
+void vars_print_exported(void);
+
+// word with $NAME, ${NAME}, $? and $$ replaced, allocated from arena.
+// Unset variables expand to nothing; a '$' not followed by a name stays.
+char *vars_expand(Arena *arena, const char *word);
+
+// Copy of cmd with its words expanded, or cmd itself if it has no '$'.
+// An argument that expands to nothing is dropped. NULL if arena ran out.
+CommandNode *vars_expand_command(Arena *arena, CommandNode *cmd);
+
+#endif // VARS_H
@@ -16,6 +16,14 @@ if {![info exists env(HOSTNAME)]} {
     set env(HOSTNAME) [exec hostname]
 }
 
+# Keep each spawned shell's history to itself instead of ~/.shell_history,
+# so log output does not depend on earlier tests or runs
+set env(HISTFILE) ""
+
+# Plain line input: the editor redraws the whole line on every key, which
+# the patterns below do not expect. The editor tests turn it back on.
+set env(TERM) dumb
+
 set user $env(USER)
 set hostname $env(HOSTNAME)
 set shell_prompt_regex "<${user}@${hostname}:\[^>]+> "
@@ -275,6 +283,12 @@ proc run_shell_behavior_tests {} {
 
     run_test "command with invalid path" "" \
         [list [list "/nonexistent/command" "Command not found!"]]
+
+    # The failed child had already been given the terminal
+    run_test "shell keeps reading after a command fails to start" "" [list \
+        [list "nonexistentcommand" "nonexistentcommand: "] \
+        [list "echo alive" "\r\nalive\r\n"] \
+    ]
 }
 
 proc run_hop_basic_tests {} {
@@ -290,6 +304,14 @@ proc run_hop_basic_tests {} {
 
     run_test "hop to nonexistent directory" "" \
         [list [list "hop /nonexistent/dir" "No such directory!"]]
+
+    run_test "prompt follows every hop" "mkdir -p $TEMP_DIR/p/q" [list \
+        [list "hop $TEMP_DIR/p/q" ":~/$TEMP_DIR/p/q> "] \
+        [list "hop .." ":~/$TEMP_DIR/p> "] \
+        [list "hop /nonexistent" ":~/$TEMP_DIR/p> "] \
+        [list "hop /" ":/> "] \
+        [list "hop ~" ":~> "] \
+    ]
 }
 
 proc run_hop_prompt_tests {} {
@@ -379,7 +401,14 @@ proc run_reveal_basic_tests {} {
         [list [list "reveal -a $TEMP_DIR" "\..*\.\..*.*f1.*f2.*"]]
 
     run_test "reveal sorted" "mkdir $TEMP_DIR/sort ; touch $TEMP_DIR/sort/Makefile $TEMP_DIR/sort/README.md $TEMP_DIR/sort/include $TEMP_DIR/sort/123 $TEMP_DIR/sort/.git" \
-        [list [list "reveal -la $TEMP_DIR/sort" ".\r\n..\r\n.git\r\n123\r\nMakefile\r\nREADME.md\r\ninclude"]]
+        [list [list "reveal -la $TEMP_DIR/sort" ".* \\.\r\n.* \\.\\.\r\n.* \\.git\r\n.* 123\r\n.* Makefile\r\n.* README\\.md\r\n.* include"]]
+
+    run_test "reveal an empty directory" "mkdir $TEMP_DIR/empty" \
+        [list [list "reveal $TEMP_DIR/empty ; echo done" "; echo done\r\ndone"]]
+
+    run_test "reveal into a pipe prints one name per line" \
+        "mkdir $TEMP_DIR/lines ; touch $TEMP_DIR/lines/a $TEMP_DIR/lines/b" \
+        [list [list "reveal $TEMP_DIR/lines | wc -l" "\r\n *2\r\n"]]
 
     run_test "reveal nonexistent directory" "" \
         [list [list "reveal /nonexistent" "No such directory!"]]
@@ -538,6 +567,47 @@ proc run_pipe_chain_tests {} {
         [list [list "echo test | invalidcommand" "Command not found!"]]
 }
 
+proc run_pipe_job_tests {} {
+    global shell_executable shell_prompt_regex verbose style
+
+    print_section "pipelines as one job"
+
+    run_test "five command pipe" "" \
+        [list [list "echo a b c | cat | cat | cat | wc -w" "3"]]
+
+    puts "$style(test)test$style(reset) | ctrl+z stops every stage"
+    log_user $verbose
+    spawn -noecho $shell_executable
+    expect -re $shell_prompt_regex
+    send "sleep 30 | sleep 30 | sleep 30\r"
+    sleep 0.5
+    send "\x1a"
+    sleep 0.5
+    send "activities\r"
+    expect -re {\[1\] \d+ Stopped sleep 30 \| sleep 30 \| sleep 30} {
+        print_test_result "ctrl+z stops every stage" "pass"
+    } timeout {
+        print_test_result "ctrl+z stops every stage" "fail" \
+            "pipeline was not listed as one stopped job"
+    }
+    expect -re $shell_prompt_regex
+
+    puts "$style(test)test$style(reset) | ctrl+c ends every stage"
+    send "fg 1\r"
+    sleep 0.5
+    send "\x03"
+    expect -re $shell_prompt_regex
+    send "activities ; echo listed\r"
+    expect -re {listed\r\nlisted} {
+        print_test_result "ctrl+c ends every stage" "pass"
+    } timeout {
+        print_test_result "ctrl+c ends every stage" "fail" \
+            "pipeline still listed after ctrl+c"
+    }
+    send "\x04"; expect eof; catch {wait}
+    log_user 1
+}
+
 proc run_sequential_tests {} {
     print_section "sequential operator"
 
@@ -575,6 +645,9 @@ proc run_job_background_tests {} {
 
     run_job_control_test
     run_async_notification_test
+
+    run_test "job completion reported while idle" "" \
+        [list [list "sleep 1 &" {\[1\] Done sleep 1}]]
 }
 
 proc run_job_management_tests {} {
@@ -614,6 +687,36 @@ proc run_job_management_tests {} {
     log_user 1
 }
 
+proc run_activities_usage_tests {} {
+    print_section "activities usage figures"
+
+    set busy "awk BEGIN{while(i++-20000000)x=x}BEGIN{getline} &"
+    set big "awk BEGIN{while(i++-200000)a\[i\]=i}BEGIN{getline} &"
+    set job {\[1\] \d+ Running \d+:\d\d:\d\d cpu \d+\.\d\ds rss \d+ KiB }
+    set proc {    \d+ S cpu \d+\.\d\ds rss \d+ KiB sleep\r\n}
+
+    run_test "activities -v shows every process" "" [list \
+        [list "sleep 5 | sleep 5 &" {\[1\] \d+}] \
+        [list "activities -v" "${job}sleep 5 \\| sleep 5\r\n$proc$proc"] \
+    ]
+
+    # awk stops on SIGTTIN once it reads the terminal, after the loop
+    run_test "activities -s cpu lists the busiest job first" "" [list \
+        [list "sleep 5 &" {\[1\] \d+}] \
+        [list $busy {Stopped: \[2\]}] \
+        [list "activities -s cpu" {\[2\] \d+ Stopped awk[^\r]*\r\n\[1\] }] \
+    ]
+
+    run_test "activities -s mem lists the largest job first" "" [list \
+        [list "sleep 5 &" {\[1\] \d+}] \
+        [list $big {Stopped: \[2\]}] \
+        [list "activities -s mem" {\[2\] \d+ Stopped awk[^\r]*\r\n\[1\] }] \
+    ]
+
+    run_test "activities with a bad sort key" "" \
+        [list [list "activities -s disk" {Usage: activities \[-v\] }]]
+}
+
 proc run_signal_tests {} {
     global shell_executable shell_prompt_regex verbose style
 
@@ -722,6 +825,30 @@ proc run_history_management_tests {} {
     ]
 }
 
+proc run_history_file_tests {} {
+    global env TEMP_DIR
+    print_section "log (history) file"
+
+    set env(HISTFILE) "$TEMP_DIR/history"
+
+    run_test "history saved to HISTFILE" "rm -f $TEMP_DIR/history" \
+        [list [list "echo persisted" "persisted"]]
+
+    run_test "history loaded from HISTFILE" "" \
+        [list [list "log" "echo persisted"]]
+
+    run_test "log -f searches HISTFILE before it is loaded" "" \
+        [list [list "log -f persist" "1: echo persisted\r\n"]]
+
+    run_test "log -f searches the loaded history" "" [list \
+        [list "echo second" "second"] \
+        [list "log" "echo second"] \
+        [list "log -f echo" "1: echo persisted\r\n4: echo second\r\n"] \
+    ]
+
+    set env(HISTFILE) ""
+}
+
 proc run_complex_command_tests {} {
     global TEMP_DIR
 
@@ -737,6 +864,451 @@ proc run_complex_command_tests {} {
         [list [list "reveal $TEMP_DIR | grep builtin_pipe | wc -l" "1"]]
 }
 
+proc run_parsecache_tests {} {
+    print_section "parse cache"
+
+    run_test "parsecache counts repeated lines" "" [list \
+        [list "echo cached" "cached"] \
+        [list "echo cached" "cached"] \
+        [list "parsecache" "parsecache: 1 hits, 2 misses, 2/32 lines cached"] \
+    ]
+
+    run_test "parsecache -c empties the cache" "" [list \
+        [list "echo cached" "cached"] \
+        [list "parsecache -c" ""] \
+        [list "parsecache" " 1/32 lines cached"] \
+    ]
+
+    run_test "parsecache -c mid-line keeps the running line" "" [list \
+        [list "parsecache -c ; echo after" "after"] \
+        [list "parsecache" " 1/32 lines cached"] \
+    ]
+}
+
+proc run_hash_tests {} {
+    global TEMP_DIR
+
+    print_section "hash (command path cache)"
+
+    run_test "hash with an empty table" "" \
+        [list [list "hash" "hash table empty"]]
+
+    run_test "hash remembers commands that ran" "" [list \
+        [list "ls /dev/null" "/dev/null"] \
+        [list "ls /dev/null" "/dev/null"] \
+        [list "hash" "hits\tcommand\r\n +1\t\[^\r]*/ls"] \
+        [list "hash -s" "hash: 1 hits, 1 misses"] \
+    ]
+
+    run_test "hash -r forgets every command" "" [list \
+        [list "hash ls" ""] \
+        [list "hash -r" ""] \
+        [list "hash" "hash table empty"] \
+    ]
+
+    run_test "hash unknown command" "" \
+        [list [list "hash nosuchcommand" "hash: nosuchcommand: not found"]]
+
+    set pc "[pwd]/$TEMP_DIR/pc"
+    set script "printf '#!/bin/sh\\necho %s\\n' > %s ; chmod +x %s"
+    set setup "mkdir -p $pc/bin $pc/a $pc/b"
+    append setup " ; [format $script {from bin} $pc/bin/ls $pc/bin/ls]"
+    append setup " ; [format $script {from a} $pc/a/pccmd $pc/a/pccmd]"
+
+    run_test "a PATH prefix assignment is searched" $setup [list \
+        [list "ls /dev/null" "/dev/null"] \
+        [list "PATH=$pc/bin ls" "from bin\r\n"] \
+    ]
+
+    # An empty element is the current directory, wherever that is now
+    run_test "an empty PATH element is not cached" $setup [list \
+        [list "export PATH=:\$PATH" ""] \
+        [list "hop $pc/a" ""] \
+        [list "pccmd" "from a\r\n"] \
+        [list "ls -1 $pc" "a\r\nb\r\nbin\r\n"] \
+        [list "hop ../bin" ""] \
+        [list "ls" "from bin\r\n"] \
+    ]
+
+    run_test "an unset PATH searches the default path" $setup [list \
+        [list "hop $pc/bin" ""] \
+        [list "unset PATH" ""] \
+        [list "ls -1 $pc" "a\r\nb\r\nbin\r\n"] \
+    ]
+}
+
+proc run_history_expansion_tests {} {
+    print_section "history expansion"
+
+    run_test "!! repeats the last command" "" [list \
+        [list "echo first" "first"] \
+        [list "!!" "echo first\r\nfirst"] \
+    ]
+
+    run_test "!n runs history entry n" "" [list \
+        [list "echo one" "one"] \
+        [list "echo two" "two"] \
+        [list "!1" "echo one\r\none"] \
+    ]
+
+    run_test "!-n counts back from the last command" "" [list \
+        [list "echo one" "one"] \
+        [list "echo two" "two"] \
+        [list "!-2" "echo one\r\none"] \
+    ]
+
+    run_test "history expansion of a missing entry" "" \
+        [list [list "!99" "!99: event not found"]]
+}
+
+proc run_heredoc_tests {} {
+    print_section "here-documents"
+
+    run_test "here-document into an external command" "" [list \
+        [list "tr a-z A-Z << EOF" "> "] \
+        [list "small body" "> "] \
+        [list "EOF" "SMALL BODY"] \
+    ]
+
+    run_test "here-document into a builtin" "" [list \
+        [list "cat << END" "> "] \
+        [list "line one" "> "] \
+        [list "line two" "> "] \
+        [list "END" "END\r\nline one\r\nline two"] \
+    ]
+
+    # Over PIPE_BUF the body goes through a memfd instead of a pipe
+    set line [string repeat "x" 59]
+    set steps [list [list "wc -c << EOF" "> "]]
+    for {set i 0} {$i < 100} {incr i} {
+        lappend steps [list $line "> "]
+    }
+    lappend steps [list "EOF" "6000"]
+    run_test "here-document larger than a pipe buffer" "" $steps
+}
+
+proc run_parallel_tests {} {
+    global shell_executable shell_prompt_regex verbose style TEMP_DIR
+
+    print_section "parallel"
+
+    run_test "parallel appends each line" "" \
+        [list [list "seq 3 | parallel -j 1 echo item" \
+                   "item 1\r\nitem 2\r\nitem 3"]]
+
+    run_test "parallel substitutes {}" "" \
+        [list [list "seq 2 | parallel -j 1 echo n{}n" "n1n\r\nn2n"]]
+
+    # One after the other they would take longer than the timeout
+    run_test "parallel runs items at once" \
+        "printf '1\\n1\\n1\\n1\\n' > $TEMP_DIR/ones" \
+        [list [list "parallel -j 4 sleep < $TEMP_DIR/ones ; echo finished" \
+                   "\r\nfinished"]]
+
+    run_test "parallel reports failed items" "" \
+        [list [list "seq 2 | parallel -j 1 false" \
+                   "parallel: false 1: exit status 1"]]
+
+    run_test "parallel -v reports every item" "" \
+        [list [list "seq 2 | parallel -v -j 1 true" \
+                   "true 1: exit status 0\r\nparallel: true 2: exit status 0"]]
+
+    run_test "a worker that stops stops the whole job" \
+        "printf 'kill -STOP \$\$\\necho resumed \$1\\n' > $TEMP_DIR/stop.sh" \
+        [list \
+            [list "seq 1 | parallel sh $TEMP_DIR/stop.sh" {\[1\] \d+ seq 1}] \
+            [list "activities" {\[1\] \d+ Stopped seq 1}] \
+            [list "fg 1" "\r\nresumed 1\r\n"] \
+        ]
+
+    puts "$style(test)test$style(reset) | ctrl+z stops parallel on its own"
+    exec sh -c "printf '5\\n5\\n' > $TEMP_DIR/fives"
+    log_user $verbose
+    spawn -noecho $shell_executable
+    expect -re $shell_prompt_regex
+    send "parallel -j 2 sleep < $TEMP_DIR/fives\r"
+    sleep 0.5
+    send "\x1a"
+    expect -re {\[1\] \d+ parallel -j 2 sleep} {
+        send "activities\r"
+        expect -re {\[1\] \d+ Stopped parallel} {
+            print_test_result "ctrl+z stops parallel on its own" "pass"
+        } timeout {
+            print_test_result "ctrl+z stops parallel on its own" "fail" \
+                "the job is not listed as stopped"
+        }
+    } timeout {
+        print_test_result "ctrl+z stops parallel on its own" "fail" \
+            "shell did not take the prompt back after ctrl+z"
+    }
+    send "\x04"; expect eof; catch {wait}
+    log_user 1
+
+    run_test "parallel -j needs a positive number" "" \
+        [list [list "parallel -j 0 echo" \
+                   "parallel: -j needs a positive number"]]
+}
+
+proc run_pipeline_stop_tests {} {
+    global shell_executable shell_prompt_regex verbose style
+
+    print_section "ctrl+z on pipelines ending in a builtin"
+
+    foreach cmd {"sleep 30 | cat" "yes | cat > /dev/null" \
+                 "sleep 30 | parallel echo"} {
+        puts "$style(test)test$style(reset) | ctrl+z stops $cmd"
+        log_user $verbose
+        spawn -noecho $shell_executable
+        expect -re $shell_prompt_regex
+        send "$cmd\r"
+        sleep 0.5
+        send "\x1a"
+        sleep 0.5
+        send "activities\r"
+        expect -re {\[1\] \d+ Stopped } {
+            print_test_result "ctrl+z stops $cmd" "pass"
+        } timeout {
+            print_test_result "ctrl+z stops $cmd" "fail" \
+                "shell did not take the prompt back after ctrl+z"
+        }
+        send "\x04"; expect eof; catch {wait}
+        log_user 1
+    }
+
+    # The pipeline activities runs in is in the job table meanwhile
+    run_test "activities in a pipeline does not list itself" "" \
+        [list [list "sleep 1 | activities ; echo end" "; echo end\r\nend"]]
+}
+
+proc run_batch_mode_tests {} {
+    global shell_executable TEMP_DIR style
+
+    print_section "batch mode"
+
+    puts "$style(test)test$style(reset) | -c runs a command string"
+    if {[catch {exec $shell_executable -c "echo one; echo two"} out] == 0 &&
+        $out == "one\ntwo"} {
+        print_test_result "-c runs a command string" "pass"
+    } else {
+        print_test_result "-c runs a command string" "fail" "got '$out'"
+    }
+
+    # Piped stdin keeps history and !! as at the prompt
+    puts "$style(test)test$style(reset) | piped stdin expands !!"
+    if {[catch {exec $shell_executable << "echo a\n!!\n"} out] == 0 &&
+        $out == "a\necho a\na"} {
+        print_test_result "piped stdin expands !!" "pass"
+    } else {
+        print_test_result "piped stdin expands !!" "fail" "got '$out'"
+    }
+
+    puts "$style(test)test$style(reset) | script file"
+    set fd [open "$TEMP_DIR/script.sh" w]
+    puts $fd "# comment"
+    puts $fd "echo from script"
+    puts $fd "echo piped | tr a-z A-Z"
+    close $fd
+    if {[catch {exec $shell_executable $TEMP_DIR/script.sh} out] == 0 &&
+        $out == "from script\nPIPED"} {
+        print_test_result "script file" "pass"
+    } else {
+        print_test_result "script file" "fail" "got '$out'"
+    }
+
+    puts "$style(test)test$style(reset) | -c exit status"
+    catch {exec $shell_executable -c "false"} out options
+    set code [lindex [dict get $options -errorcode] end]
+    if {$code == 1} {
+        print_test_result "-c exit status" "pass"
+    } else {
+        print_test_result "-c exit status" "fail" "exit status '$code'"
+    }
+}
+
+proc run_time_tests {} {
+    print_section "time keyword"
+
+    run_test "time reports wall and cpu time" "" \
+        [list [list "time sleep 0.2" "real\t0m0\\.2\\d+s\r\nuser\t.*\r\nsys\t"]]
+
+    run_test "time reports rss and context switches" "" \
+        [list [list "time true" "maxrss\t\\d+ KiB\r\nctxsw\t\\d+ voluntary"]]
+}
+
+proc run_bglimit_tests {} {
+    print_section "bglimit (background job queue)"
+
+    run_test "bglimit without a limit" "" \
+        [list [list "bglimit" "unlimited"]]
+
+    run_test "bglimit queues jobs over the limit" "" [list \
+        [list "bglimit 1" ""] \
+        [list "sleep 1 &" {\[1\] \d+ sleep 1}] \
+        [list "echo ran &" {\[2\] Queued echo ran}] \
+        [list "activities" {\[2\] - Queued echo ran}] \
+        [list "sleep 1.5" "\r\nran"] \
+    ]
+
+    run_test "bglimit rejects a negative limit" "" \
+        [list [list "bglimit -1" "Usage: bglimit \\\[N\\\]"]]
+}
+
+proc run_wait_tests {} {
+    print_section "wait"
+
+    run_test "wait for one job" "" [list \
+        [list "sleep 1 &" {\[1\] \d+ sleep 1}] \
+        [list "wait %1 ; echo status \$?" "\r\nstatus 0"] \
+    ]
+
+    run_test "wait for every job" "" [list \
+        [list "sleep 1 &" {\[1\] \d+ sleep 1}] \
+        [list "sleep 1 &" {\[2\] \d+ sleep 1}] \
+        [list "wait ; echo status \$?" "\r\nstatus 0"] \
+    ]
+
+    run_test "wait -n with nothing to wait for" "" \
+        [list [list "wait -n ; echo status \$?" "\r\nstatus 127"]]
+
+    run_test "wait for an unknown job" "" \
+        [list [list "wait %9" "wait: job not found: %9"]]
+}
+
+proc run_pipestatus_tests {} {
+    global shell_prompt_regex
+    set prompt $shell_prompt_regex
+
+    print_section "pipestatus"
+
+    run_test "pipestatus of every stage" "" [list \
+        [list "true | false | true" $prompt] \
+        [list "pipestatus" "\r\n0 1 0"] \
+    ]
+
+    run_test "pipestatus of a single command" "" [list \
+        [list "false" $prompt] \
+        [list "pipestatus" "\r\n1\r\n"] \
+    ]
+
+    run_test "pipestatus of a stage that cannot start" "" [list \
+        [list "echo a | nosuchcommand" $prompt] \
+        [list "pipestatus" "\r\n\\d+ 127"] \
+    ]
+}
+
+proc run_cat_tests {} {
+    global TEMP_DIR
+    print_section "cat builtin"
+
+    run_test "cat joins files in order" \
+        "echo alpha > $TEMP_DIR/c1 ; echo beta > $TEMP_DIR/c2" \
+        [list [list "cat $TEMP_DIR/c1 $TEMP_DIR/c2" "\r\nalpha\r\nbeta"]]
+
+    run_test "cat from a pipe" "" \
+        [list [list "echo piped | cat | tr a-z A-Z" "PIPED"]]
+
+    run_test "cat - reads stdin between files" "echo alpha > $TEMP_DIR/c1" \
+        [list [list "echo middle | cat $TEMP_DIR/c1 - $TEMP_DIR/c1" \
+                   "\r\nalpha\r\nmiddle\r\nalpha"]]
+
+    run_test "cat of a missing file" "" \
+        [list [list "cat $TEMP_DIR/nosuchfile" \
+                   "cat: $TEMP_DIR/nosuchfile: No such file or directory"]]
+
+    run_test "cat with options runs the external cat" \
+        "printf 'a\\n\\nb\\n' > $TEMP_DIR/c3" [list \
+        [list "cat -n $TEMP_DIR/c3" "1\ta\r\n +2\t\r\n +3\tb"] \
+        [list "cat -A $TEMP_DIR/c3" "a\\\$\r\n\\\$\r\nb\\\$"] \
+        [list "cat -- $TEMP_DIR/c3" "\r\na\r\n\r\nb"] \
+    ]
+}
+
+proc run_variable_tests {} {
+    global shell_prompt_regex
+    set prompt $shell_prompt_regex
+
+    print_section "variables, export and unset"
+
+    run_test "set and expand a variable" "" [list \
+        [list "x=hello" $prompt] \
+        [list "echo val:\$x" "\r\nval:hello"] \
+    ]
+
+    run_test "export reaches child processes" "" [list \
+        [list "export GREETING=hi" $prompt] \
+        [list "printenv GREETING" "\r\nhi\r\n"] \
+    ]
+
+    run_test "unexported variables stay in the shell" "" [list \
+        [list "local_only=1" $prompt] \
+        [list "printenv local_only ; echo status \$?" "\r\nstatus 1"] \
+    ]
+
+    run_test "unset removes an exported variable" "" [list \
+        [list "export GONE=1" $prompt] \
+        [list "unset GONE" $prompt] \
+        [list "printenv GONE ; echo status \$?" "\r\nstatus 1"] \
+    ]
+
+    run_test "prefix assignment lasts one command" "" [list \
+        [list "ONCE=1 printenv ONCE" "\r\n1\r\n"] \
+        [list "echo once:\$ONCE" "\r\nonce:\r\n"] \
+    ]
+
+    run_test "\$? of a pipeline is its last stage's" "" [list \
+        [list "false | true ; echo status \$?" "\r\nstatus 0"] \
+        [list "true | false ; echo status \$?" "\r\nstatus 1"] \
+    ]
+}
+
+proc run_line_editor_tests {} {
+    global TEMP_DIR env
+
+    print_section "line editor"
+
+    # The editor is off for dumb terminals
+    set env(TERM) xterm
+    set ed "$TEMP_DIR/ed"
+
+    run_test "tab completes a command" "" \
+        [list [list "ech\thi" "\r\nhi\r\n"]]
+
+    run_test "tab completes a file" "mkdir -p $ed ; touch $ed/unique_file" \
+        [list [list "echo $ed/uni\t" "\r\n$ed/unique_file\r\n"]]
+
+    run_test "tab completes a directory" "mkdir -p $ed/subdir_x" \
+        [list [list "echo $ed/subd\t" "\r\n$ed/subdir_x/\r\n"]]
+
+    run_test "tab twice lists ambiguous matches" \
+        "mkdir -p $ed ; touch $ed/amb_one $ed/amb_two" \
+        [list [list "echo $ed/amb\t\t" "\r\namb_one +amb_two\r\n"]]
+
+    run_test "up arrow recalls the last command" "" [list \
+        [list "echo first_cmd" "\r\nfirst_cmd\r\n"] \
+        [list "\x1b\[A" "\r\nfirst_cmd\r\n"] \
+    ]
+
+    set bin "[pwd]/$TEMP_DIR/bin"
+    run_test "command completion follows a PATH change" \
+        "mkdir -p $bin ; printf '#!/bin/sh\\necho zq ran\\n' > $bin/zqtool ; chmod +x $bin/zqtool" \
+        [list \
+            [list "zqt\t" "zqt: "] \
+            [list "export PATH=$bin:\$PATH" ""] \
+            [list "zqt\t" "\r\nzq ran\r\n"] \
+        ]
+
+    run_test "file completion follows hop" \
+        "mkdir -p $ed/a $ed/b ; touch $ed/a/only_in_a $ed/b/only_in_b" \
+        [list \
+            [list "hop $ed/a" ""] \
+            [list "echo only\t" "\r\nonly_in_a\r\n"] \
+            [list "hop ../b" ""] \
+            [list "echo only\t" "\r\nonly_in_b\r\n"] \
+        ]
+
+    set env(TERM) dumb
+}
+
 proc print_results {} {
     global PASS_COUNT FAIL_COUNT style
 
@@ -798,15 +1370,32 @@ proc main {} {
     run_multiple_redirect_tests
     run_pipe_basic_tests
     run_pipe_chain_tests
+    run_pipe_job_tests
     run_sequential_tests
     # run_conditional_tests
     run_job_background_tests
     run_job_management_tests
+    run_activities_usage_tests
     run_signal_tests
     run_history_basic_tests
     run_history_execute_tests
     run_history_management_tests
+    run_history_file_tests
     run_complex_command_tests
+    run_parsecache_tests
+    run_hash_tests
+    run_history_expansion_tests
+    run_heredoc_tests
+    run_parallel_tests
+    run_pipeline_stop_tests
+    run_batch_mode_tests
+    run_line_editor_tests
+    run_time_tests
+    run_bglimit_tests
+    run_wait_tests
+    run_pipestatus_tests
+    run_cat_tests
+    run_variable_tests
 
     print_results
 }
@@ -0,0 +1,86 @@
+#include "../include/arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_CHUNK_SIZE 4096
+#define ARENA_ALIGN 16
+
+static ArenaChunk *new_chunk(size_t min_size) {
+  size_t size = min_size > ARENA_CHUNK_SIZE ? min_size : ARENA_CHUNK_SIZE;
+  ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + size);
+  if (!chunk) {
+    perror("malloc");
+    return NULL;
+  }
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->used = 0;
+  return chunk;
+}
+
+void arena_init(Arena *arena) {
+  arena->head = NULL;
+  arena->current = NULL;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  ArenaChunk *chunk = arena->current;
+  if (chunk && chunk->size - chunk->used >= size) {
+    void *p = chunk->data + chunk->used;
+    chunk->used += size;
+    return p;
+  }
+
+  // Move on to the next chunk kept from before the last reset, or splice a
+  // fresh one in if that one is too small.
+  ArenaChunk *next = chunk ? chunk->next : arena->head;
+  if (!next || next->size < size) {
+    ArenaChunk *fresh = new_chunk(size);
+    if (!fresh)
+      return NULL;
+    fresh->next = next;
+    if (chunk)
+      chunk->next = fresh;
+    else
+      arena->head = fresh;
+    next = fresh;
+  }
+  next->used = size;
+  arena->current = next;
+  return next->data;
+}
+
+void *arena_calloc(Arena *arena, size_t count, size_t size) {
+  void *p = arena_alloc(arena, count * size);
+  if (p)
+    memset(p, 0, count * size);
+  return p;
+}
+
+char *arena_strndup(Arena *arena, const char *s, size_t n) {
+  char *copy = arena_alloc(arena, n + 1);
+  if (!copy)
+    return NULL;
+  memcpy(copy, s, n);
+  copy[n] = '\0';
+  return copy;
+}
+
+void arena_reset(Arena *arena) {
+  if (arena->head)
+    arena->head->used = 0;
+  arena->current = arena->head;
+}
+
+void arena_free(Arena *arena) {
+  ArenaChunk *chunk = arena->head;
+  while (chunk) {
+    ArenaChunk *next = chunk->next;
+    free(chunk);
+    chunk = next;
+  }
+  arena_init(arena);
+}
@@ -0,0 +1,158 @@
+#include "../include/astcache.h"
+
+typedef struct CacheEntry {
+  size_t hash;
+  size_t len;
+  const char *line; // Copy of the key, in arena
+  ASTNode *ast;     // NULL while the slot is unused
+  int pins;         // Handed out and not yet released
+  Arena arena;
+  struct CacheEntry *prev, *next; // Most recently used first
+} CacheEntry;
+
+static CacheEntry entries[AST_CACHE_SIZE];
+static CacheEntry *lru_head = NULL;
+static CacheEntry *lru_tail = NULL;
+static size_t entry_count = 0;
+static unsigned long total_hits = 0;
+static unsigned long total_misses = 0;
+static int total_pins = 0;
+static int clear_pending = 0; // ast_cache_clear ran while a tree was pinned
+
+// FNV-1a, also yields the length
+static size_t hash_line(const char *line, size_t *len) {
+  size_t h = 2166136261u;
+  const unsigned char *p = (const unsigned char *)line;
+  for (; *p; p++) {
+    h ^= *p;
+    h *= 16777619u;
+  }
+  *len = (const char *)p - line;
+  return h;
+}
+
+static void lru_unlink(CacheEntry *e) {
+  if (e->prev)
+    e->prev->next = e->next;
+  else
+    lru_head = e->next;
+  if (e->next)
+    e->next->prev = e->prev;
+  else
+    lru_tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void lru_push_front(CacheEntry *e) {
+  e->prev = NULL;
+  e->next = lru_head;
+  if (lru_head)
+    lru_head->prev = e;
+  else
+    lru_tail = e;
+  lru_head = e;
+}
+
+// An unused slot, or the least recently used unpinned one emptied for
+// reuse. NULL if every slot holds a tree that is still running.
+static CacheEntry *take_slot(void) {
+  if (entry_count < AST_CACHE_SIZE) {
+    CacheEntry *e = &entries[entry_count++];
+    arena_init(&e->arena);
+    return e;
+  }
+  CacheEntry *e = lru_tail;
+  while (e && e->pins > 0)
+    e = e->prev;
+  if (!e)
+    return NULL;
+  lru_unlink(e);
+  arena_reset(&e->arena);
+  e->ast = NULL;
+  return e;
+}
+
+ASTNode *ast_cache_get(const char *line) {
+  size_t len;
+  size_t hash = hash_line(line, &len);
+
+  // With this few entries a scan over the recency list beats a hash table
+  for (CacheEntry *e = lru_head; e; e = e->next) {
+    if (e->hash == hash && e->len == len && memcmp(e->line, line, len) == 0) {
+      total_hits++;
+      if (e != lru_head) {
+        lru_unlink(e);
+        lru_push_front(e);
+      }
+      e->pins++;
+      total_pins++;
+      return e->ast;
+    }
+  }
+
+  total_misses++;
+  CacheEntry *e = take_slot();
+  if (!e)
+    return NULL;
+  ASTNode *ast = parse_input(&e->arena, line);
+  char *key = ast ? arena_strndup(&e->arena, line, len) : NULL;
+  if (!key) {
+    // Keep the slot at the cold end so it is reused first
+    arena_reset(&e->arena);
+    e->ast = NULL;
+    if (lru_tail) {
+      e->prev = lru_tail;
+      lru_tail->next = e;
+      lru_tail = e;
+    } else {
+      lru_head = lru_tail = e;
+    }
+    e->hash = 0;
+    e->len = (size_t)-1; // Never matches a key
+    return NULL;
+  }
+  e->hash = hash;
+  e->len = len;
+  e->line = key;
+  e->ast = ast;
+  e->pins = 1;
+  total_pins++;
+  lru_push_front(e);
+  return ast;
+}
+
+void ast_cache_release(ASTNode *ast) {
+  for (size_t i = 0; i < entry_count; i++) {
+    if (entries[i].ast == ast && entries[i].pins > 0) {
+      entries[i].pins--;
+      break;
+    }
+  }
+  if (--total_pins == 0 && clear_pending)
+    ast_cache_clear();
+}
+
+void ast_cache_clear(void) {
+  // A tree still being executed is freed once it is released
+  if (total_pins > 0) {
+    clear_pending = 1;
+    return;
+  }
+  clear_pending = 0;
+  for (size_t i = 0; i < entry_count; i++)
+    arena_free(&entries[i].arena);
+  memset(entries, 0, sizeof(entries));
+  lru_head = lru_tail = NULL;
+  entry_count = 0;
+}
+
+void ast_cache_stats(unsigned long *hits, unsigned long *misses,
+                     size_t *entries_out) {
+  *hits = total_hits;
+  *misses = total_misses;
+  *entries_out = 0;
+  for (CacheEntry *e = lru_head; e; e = e->next) {
+    if (e->ast)
+      (*entries_out)++;
+  }
+}
@@ -0,0 +1,154 @@
+#define _GNU_SOURCE // copy_file_range, splice
+#include "../include/intrinsics.h"
+#include <sys/sendfile.h>
+
+#define CAT_CHUNK (1 << 30) // Per call; the kernel caps it anyway
+#define CAT_BUF_SIZE 65536
+
+// How data gets from one descriptor to the other, cheapest first
+typedef enum {
+  COPY_RANGE,    // copy_file_range: file to file, may share extents
+  COPY_SPLICE,   // splice: either side is a pipe
+  COPY_SENDFILE, // sendfile: from a file to anything
+  COPY_RW        // read/write through a buffer
+} CopyMethod;
+
+static CopyMethod first_method(const struct stat *in, const struct stat *out) {
+  if (S_ISFIFO(in->st_mode) || S_ISFIFO(out->st_mode))
+    return COPY_SPLICE;
+  if (S_ISREG(in->st_mode) && S_ISREG(out->st_mode))
+    return COPY_RANGE;
+  if (S_ISREG(in->st_mode) || S_ISBLK(in->st_mode))
+    return COPY_SENDFILE;
+  return COPY_RW;
+}
+
+// The method to try when one is refused for this pair of descriptors
+static CopyMethod next_method(CopyMethod m, const struct stat *in) {
+  if (m != COPY_SENDFILE && S_ISREG(in->st_mode))
+    return COPY_SENDFILE;
+  return COPY_RW;
+}
+
+static ssize_t read_write(int in, int out) {
+  char buf[CAT_BUF_SIZE];
+  ssize_t n = read(in, buf, sizeof(buf));
+  if (n <= 0)
+    return n;
+  for (ssize_t off = 0; off < n;) {
+    ssize_t w = write(out, buf + off, n - off);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w < 0)
+      return -1;
+    off += w;
+  }
+  return n;
+}
+
+// Copy in to out until end of input. The kernel moves the data itself
+// where it can; offsets advance with every call, so falling back to a
+// slower method part way through loses nothing.
+static int copy_fd(int in, int out) {
+  struct stat in_st, out_st;
+  if (fstat(in, &in_st) < 0 || fstat(out, &out_st) < 0)
+    return -1;
+  CopyMethod method = first_method(&in_st, &out_st);
+  int moved = 0; // A refusal after the first chunk is a real error
+
+  for (;;) {
+    ssize_t n;
+    switch (method) {
+    case COPY_RANGE:
+      n = copy_file_range(in, NULL, out, NULL, CAT_CHUNK, 0);
+      break;
+    case COPY_SPLICE:
+      n = splice(in, NULL, out, NULL, CAT_CHUNK, SPLICE_F_MOVE);
+      break;
+    case COPY_SENDFILE:
+      n = sendfile(out, in, NULL, CAT_CHUNK);
+      break;
+    default:
+      n = read_write(in, out);
+      break;
+    }
+    if (n == 0)
+      return 0;
+    if (n > 0) {
+      moved = 1;
+      continue;
+    }
+    if (errno == EINTR)
+      continue;
+    // Unsupported for these files (filesystem, O_APPEND output, ...)
+    if (method != COPY_RW && !moved &&
+        (errno == EINVAL || errno == EXDEV || errno == ENOSYS ||
+         errno == EOPNOTSUPP || errno == EBADF)) {
+      method = next_method(method, &in_st);
+      continue;
+    }
+    return -1;
+  }
+}
+
+// cat [file|-]...: copy files, or stdin, to stdout inside the shell. In
+// a pipeline or with redirections no data passes through user space
+// unless the kernel refuses every zero-copy path.
+int builtin_cat(char **args) {
+  struct stat out_st;
+  int status = 0;
+  fflush(stdout);
+  int have_out = fstat(STDOUT_FILENO, &out_st) == 0;
+
+  int argc = 1;
+  while (args[argc])
+    argc++;
+  // With no operands the one input is stdin
+  for (int i = argc > 1 ? 1 : 0; i < argc; i++) {
+    const char *name = i > 0 ? args[i] : "-";
+    int from_stdin = strcmp(name, "-") == 0;
+    int fd = from_stdin ? STDIN_FILENO : open(name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+      status = 1;
+      continue;
+    }
+    int reader_gone = 0;
+
+    struct stat in_st;
+    if (have_out && fstat(fd, &in_st) == 0 && S_ISREG(in_st.st_mode) &&
+        in_st.st_dev == out_st.st_dev && in_st.st_ino == out_st.st_ino) {
+      fprintf(stderr, "cat: %s: input file is output file\n", name);
+      status = 1;
+    } else if (copy_fd(fd, STDOUT_FILENO) < 0) {
+      // A reader that went away is not worth a message
+      reader_gone = errno == EPIPE;
+      if (!reader_gone)
+        fprintf(stderr, "cat: %s: %s\n", name, strerror(errno));
+      status = 1;
+    }
+    if (!from_stdin)
+      close(fd);
+    if (reader_gone)
+      return 128 + SIGPIPE; // What an external cat would die of
+  }
+  return status;
+}
+
+int cat_needs_external(CommandNode *cmd, int in_fd) {
+  if (cmd->arg_count == 0 || strcmp(cmd->args[0], "cat") != 0)
+    return 0;
+  // Options (-n, -A, --, ...) are left to the real cat; "-" is stdin
+  for (int i = 1; i < cmd->arg_count; i++) {
+    if (cmd->args[i][0] == '-' && cmd->args[i][1] != '\0')
+      return 1;
+  }
+  for (Redirection *r = cmd->redirections; r; r = r->next) {
+    if (r->type == REDIR_IN || r->type == REDIR_HEREDOC)
+      return 0;
+  }
+  int reads_stdin = cmd->arg_count == 1;
+  for (int i = 1; i < cmd->arg_count; i++)
+    reads_stdin |= strcmp(cmd->args[i], "-") == 0;
+  return reads_stdin && isatty(in_fd);
+}
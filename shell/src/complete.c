@@ -0,0 +1,421 @@
+#define _GNU_SOURCE // d_type
+#include "../include/complete.h"
+#include "../include/intrinsics.h"
+#include "../include/vars.h"
+
+#define COMPLETE_MAX_LISTINGS 16
+#define COMPLETE_NAME_MAX 256
+
+// --- Command names: a trie over $PATH and the built-ins ---
+
+typedef struct {
+  int child;   // First child, -1 if none
+  int sibling; // Next child of the same parent, in byte order
+  int count;   // Names ending in this subtree
+  unsigned char ch;
+  unsigned char terminal; // A name ends here
+} TrieNode;
+
+typedef struct {
+  char *dir;
+  struct timespec mtime;
+} PathDir;
+
+static TrieNode *trie = NULL;
+static int trie_len = 0;
+static int trie_cap = 0;
+static PathDir *path_dirs = NULL;
+static int path_dir_count = 0;
+static char *trie_path_env = NULL; // $PATH the trie was built from
+
+static int trie_new_node(unsigned char ch) {
+  if (trie_len == trie_cap) {
+    int cap = trie_cap ? trie_cap * 2 : 4096;
+    TrieNode *grown = realloc(trie, cap * sizeof(*trie));
+    if (!grown) {
+      perror("realloc");
+      return -1;
+    }
+    trie = grown;
+    trie_cap = cap;
+  }
+  trie[trie_len] = (TrieNode){-1, -1, 0, ch, 0};
+  return trie_len++;
+}
+
+static void trie_insert(const char *name) {
+  int path[COMPLETE_NAME_MAX];
+  int depth = 0;
+  int node = 0;
+  for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+    if (depth == COMPLETE_NAME_MAX - 1)
+      return;
+    path[depth++] = node;
+    // Children are kept sorted, so listings come out in order
+    int *link = &trie[node].child;
+    while (*link >= 0 && trie[*link].ch < *p)
+      link = &trie[*link].sibling;
+    if (*link < 0 || trie[*link].ch != *p) {
+      int fresh = trie_new_node(*p); // May move trie, so link is stale
+      if (fresh < 0)
+        return;
+      link = &trie[node].child;
+      while (*link >= 0 && trie[*link].ch < *p)
+        link = &trie[*link].sibling;
+      trie[fresh].sibling = *link;
+      *link = fresh;
+    }
+    node = *link;
+  }
+  if (trie[node].terminal)
+    return; // Same name earlier on $PATH
+  trie[node].terminal = 1;
+  trie[node].count++;
+  for (int i = 0; i < depth; i++)
+    trie[path[i]].count++;
+}
+
+static int is_executable(int dir_fd, const struct dirent *ent) {
+  if (ent->d_type == DT_DIR)
+    return 0;
+  if (ent->d_type != DT_REG) {
+    // Symlinks and unknown types: look at what they point to
+    struct stat st;
+    if (fstatat(dir_fd, ent->d_name, &st, 0) != 0 || S_ISDIR(st.st_mode))
+      return 0;
+  }
+  return faccessat(dir_fd, ent->d_name, X_OK, 0) == 0;
+}
+
+static void free_path_dirs(void) {
+  for (int i = 0; i < path_dir_count; i++)
+    free(path_dirs[i].dir);
+  free(path_dirs);
+  path_dirs = NULL;
+  path_dir_count = 0;
+}
+
+static void build_trie(const char *path_env) {
+  free_path_dirs();
+  free(trie_path_env);
+  trie_path_env = strdup(path_env);
+  trie_len = 0;
+  trie_new_node(0); // Root
+
+  for (int i = 0; builtin_name(i); i++)
+    trie_insert(builtin_name(i));
+
+  int dirs = 1;
+  for (const char *p = path_env; *p; p++)
+    dirs += *p == ':';
+  path_dirs = calloc(dirs, sizeof(*path_dirs));
+  if (!path_dirs)
+    return;
+
+  const char *start = path_env;
+  for (;;) {
+    const char *end = strchr(start, ':');
+    size_t n = end ? (size_t)(end - start) : strlen(start);
+    PathDir *pd = &path_dirs[path_dir_count++];
+    pd->dir = n ? strndup(start, n) : strdup("."); // Empty means cwd
+    struct stat st;
+    DIR *d = pd->dir ? opendir(pd->dir) : NULL;
+    if (d && fstat(dirfd(d), &st) == 0) {
+      pd->mtime = st.st_mtim;
+      struct dirent *ent;
+      while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] != '.' && is_executable(dirfd(d), ent))
+          trie_insert(ent->d_name);
+      }
+    }
+    if (d)
+      closedir(d);
+    if (!end)
+      break;
+    start = end + 1;
+  }
+}
+
+// Rebuild the trie if $PATH changed or a directory on it was modified.
+// Costs one stat per $PATH directory when nothing did.
+static void refresh_trie(void) {
+  const char *path_env = vars_get("PATH");
+  if (!path_env)
+    path_env = "";
+  int stale = !trie || !trie_path_env || strcmp(trie_path_env, path_env) != 0;
+  for (int i = 0; i < path_dir_count && !stale; i++) {
+    struct stat st;
+    if (stat(path_dirs[i].dir, &st) != 0) {
+      stale = path_dirs[i].mtime.tv_sec != 0; // Went away
+    } else {
+      stale = st.st_mtim.tv_sec != path_dirs[i].mtime.tv_sec ||
+              st.st_mtim.tv_nsec != path_dirs[i].mtime.tv_nsec;
+    }
+  }
+  if (stale)
+    build_trie(path_env);
+}
+
+static int complete_command(const char *word, size_t len, Completion *c) {
+  refresh_trie();
+  if (trie_len == 0)
+    return -1;
+  int node = 0;
+  for (size_t i = 0; i < len && node >= 0; i++) {
+    int child = trie[node].child;
+    while (child >= 0 && trie[child].ch != (unsigned char)word[i])
+      child = trie[child].sibling;
+    node = child;
+  }
+  if (node < 0)
+    return 0; // No matches
+
+  // Follow the only branch for as long as there is one
+  char common[COMPLETE_NAME_MAX];
+  if (len >= sizeof(common))
+    return 0;
+  memcpy(common, word, len);
+  size_t common_len = len;
+  while (!trie[node].terminal && trie[node].child >= 0 &&
+         trie[trie[node].child].sibling < 0 &&
+         common_len < sizeof(common) - 1) {
+    node = trie[node].child;
+    common[common_len++] = trie[node].ch;
+  }
+  c->count = trie[node].count;
+  c->common = strndup(common, common_len);
+  c->trie_node = node;
+  return c->common ? 0 : -1;
+}
+
+static void trie_walk(int node, char *buf, size_t len,
+                      void (*fn)(const char *name, void *arg), void *arg) {
+  if (trie[node].terminal) {
+    buf[len] = '\0';
+    fn(buf, arg);
+  }
+  if (len >= COMPLETE_NAME_MAX - 1)
+    return;
+  for (int child = trie[node].child; child >= 0;
+       child = trie[child].sibling) {
+    buf[len] = trie[child].ch;
+    trie_walk(child, buf, len + 1, fn, arg);
+  }
+}
+
+// --- File names: sorted listings, cached per directory ---
+
+typedef struct DirListing {
+  char *path; // As typed, "." for the cwd
+  struct timespec mtime;
+  char **names; // Sorted, without . and ..
+  unsigned char *is_dir;
+  size_t count;
+  struct DirListing *next; // Most recently used first
+} DirListing;
+
+static DirListing *listings = NULL;
+
+static void free_listing(DirListing *l) {
+  for (size_t i = 0; i < l->count; i++)
+    free(l->names[i]);
+  free(l->names);
+  free(l->is_dir);
+  free(l->path);
+  free(l);
+}
+
+void complete_invalidate_dirs(void) {
+  while (listings) {
+    DirListing *next = listings->next;
+    free_listing(listings);
+    listings = next;
+  }
+}
+
+static int compare_names(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static DirListing *read_listing(const char *path) {
+  DIR *d = opendir(path);
+  if (!d)
+    return NULL;
+  DirListing *l = calloc(1, sizeof(*l));
+  struct stat st;
+  if (!l || !(l->path = strdup(path)) || fstat(dirfd(d), &st) != 0) {
+    if (l)
+      free(l->path);
+    free(l);
+    closedir(d);
+    return NULL;
+  }
+  l->mtime = st.st_mtim;
+
+  size_t cap = 0;
+  struct dirent *ent;
+  while ((ent = readdir(d)) != NULL) {
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+      continue;
+    if (l->count == cap) {
+      cap = cap ? cap * 2 : 64;
+      char **names = realloc(l->names, cap * sizeof(char *));
+      if (!names)
+        break;
+      l->names = names;
+    }
+    if (!(l->names[l->count] = strdup(ent->d_name)))
+      break;
+    l->count++;
+  }
+  closedir(d);
+  if (l->count) // names is still NULL for an empty directory
+    qsort(l->names, l->count, sizeof(char *), compare_names);
+
+  // Only symlinks and unknown types need a stat to tell directories apart
+  l->is_dir = calloc(l->count ? l->count : 1, 1);
+  int dir_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  for (size_t i = 0; l->is_dir && dir_fd >= 0 && i < l->count; i++) {
+    if (fstatat(dir_fd, l->names[i], &st, 0) == 0)
+      l->is_dir[i] = S_ISDIR(st.st_mode);
+  }
+  if (dir_fd >= 0)
+    close(dir_fd);
+  if (!l->is_dir) {
+    free_listing(l);
+    return NULL;
+  }
+  return l;
+}
+
+// The listing of path, from the cache while the directory is unmodified
+static DirListing *get_listing(const char *path) {
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return NULL;
+
+  DirListing **link = &listings;
+  int kept = 0;
+  while (*link && strcmp((*link)->path, path) != 0) {
+    link = &(*link)->next;
+    kept++;
+  }
+  DirListing *l = *link;
+  if (l) {
+    *link = l->next;
+    if (l->mtime.tv_sec != st.st_mtim.tv_sec ||
+        l->mtime.tv_nsec != st.st_mtim.tv_nsec) {
+      free_listing(l);
+      l = NULL;
+    }
+  } else if (kept >= COMPLETE_MAX_LISTINGS) {
+    // Drop the least recently used listing
+    link = &listings;
+    while ((*link)->next)
+      link = &(*link)->next;
+    free_listing(*link);
+    *link = NULL;
+  }
+  if (!l && !(l = read_listing(path)))
+    return NULL;
+  l->next = listings;
+  listings = l;
+  return l;
+}
+
+// First index in [lo, hi) whose name compares above prefix (strict) or
+// at least equal to it
+static size_t search_prefix(DirListing *l, const char *prefix, size_t len,
+                            int strict) {
+  size_t lo = 0, hi = l->count;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    int cmp = strncmp(l->names[mid], prefix, len);
+    if (cmp < 0 || (strict && cmp == 0))
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static int complete_file(const char *word, size_t len, Completion *c) {
+  const char *slash = memrchr(word, '/', len);
+  char dir[PATH_MAX];
+  const char *base = word;
+  if (slash) {
+    size_t dir_len = slash - word + 1; // Keep the '/' so "/" works
+    if (dir_len >= sizeof(dir))
+      return 0;
+    memcpy(dir, word, dir_len);
+    dir[dir_len] = '\0';
+    base = slash + 1;
+  } else {
+    strcpy(dir, ".");
+  }
+  size_t base_len = word + len - base;
+
+  DirListing *l = get_listing(dir);
+  if (!l)
+    return 0;
+  c->dir = l;
+  c->first = search_prefix(l, base, base_len, 0);
+  c->end = search_prefix(l, base, base_len, 1);
+  c->skip_hidden = base_len == 0 || base[0] != '.';
+
+  // The longest common prefix of the matches
+  const char *first = NULL;
+  size_t common_len = 0;
+  for (size_t i = c->first; i < c->end; i++) {
+    const char *name = l->names[i];
+    if (c->skip_hidden && name[0] == '.')
+      continue;
+    if (!first) {
+      first = name;
+      common_len = strlen(name);
+      c->is_dir = l->is_dir[i];
+    } else {
+      size_t n = 0;
+      while (n < common_len && name[n] == first[n])
+        n++;
+      common_len = n;
+    }
+    c->count++;
+  }
+  if (c->count == 0)
+    return 0;
+  c->common = strndup(first, common_len);
+  if (c->count > 1)
+    c->is_dir = 0;
+  return c->common ? 0 : -1;
+}
+
+int complete_word(const char *word, size_t len, int command_position,
+                  Completion *c) {
+  memset(c, 0, sizeof(*c));
+  c->trie_node = -1;
+  if (command_position && !memchr(word, '/', len))
+    return complete_command(word, len, c);
+  return complete_file(word, len, c);
+}
+
+void completion_each(const Completion *c,
+                     void (*fn)(const char *name, void *arg), void *arg) {
+  if (c->trie_node >= 0) {
+    char buf[COMPLETE_NAME_MAX];
+    size_t len = strlen(c->common);
+    memcpy(buf, c->common, len);
+    trie_walk(c->trie_node, buf, len, fn, arg);
+    return;
+  }
+  const DirListing *l = c->dir;
+  for (size_t i = c->first; l && i < c->end; i++) {
+    if (!(c->skip_hidden && l->names[i][0] == '.'))
+      fn(l->names[i], arg);
+  }
+}
+
+void completion_free(Completion *c) {
+  free(c->common);
+  c->common = NULL;
+}
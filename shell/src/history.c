@@ -0,0 +1,415 @@
+#define _GNU_SOURCE // memmem
+#include "../include/history.h"
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+
+#define HISTORY_FILE_NAME ".shell_history"
+#define HISTORY_MIN_STORE 4096
+
+static size_t history_max = MAX_HISTORY;
+
+// Append-only history file and its mapping from startup
+static char history_path[PATH_MAX];
+static int history_fd = -1;
+static pid_t history_owner = 0; // Only the shell itself rewrites the file
+static char *history_map = NULL;
+static size_t history_map_len = 0;
+static int history_loaded = 0;
+static char *last_entry = NULL; // Newest entry while not loaded
+
+// In-memory store: live entries are NUL-terminated and contiguous,
+// from entry_off[first] up to store_len, oldest first
+static char *store = NULL;
+static size_t store_len = 0, store_cap = 0;
+static size_t *entry_off = NULL;
+static size_t entry_cap = 0;
+static size_t first = 0, history_count = 0;
+
+// Slide the live entries and their offsets back to the start of the
+// buffers, reclaiming the space of evicted entries
+static void compact_store(void) {
+  size_t base = history_count ? entry_off[first] : store_len;
+  if (base > 0) {
+    memmove(store, store + base, store_len - base);
+    store_len -= base;
+  }
+  if (first > 0 || base > 0) {
+    for (size_t i = 0; i < history_count; i++)
+      entry_off[i] = entry_off[first + i] - base;
+    first = 0;
+  }
+}
+
+static int reserve_store(size_t bytes, size_t entries) {
+  if (store_len + bytes <= store_cap && first + history_count + entries <=
+                                            entry_cap)
+    return 0;
+  compact_store();
+  if (store_len + bytes > store_cap / 2) {
+    size_t cap = store_cap ? store_cap : HISTORY_MIN_STORE;
+    while (cap < 2 * (store_len + bytes))
+      cap *= 2;
+    char *grown = realloc(store, cap);
+    if (!grown) {
+      perror("realloc");
+      return -1;
+    }
+    store = grown;
+    store_cap = cap;
+  }
+  if (history_count + entries > entry_cap / 2) {
+    size_t cap = entry_cap ? entry_cap : 64;
+    while (cap < 2 * (history_count + entries))
+      cap *= 2;
+    size_t *grown = realloc(entry_off, cap * sizeof(size_t));
+    if (!grown) {
+      perror("realloc");
+      return -1;
+    }
+    entry_off = grown;
+    entry_cap = cap;
+  }
+  return 0;
+}
+
+static void store_append(const char *command, size_t len) {
+  if (history_count == history_max) {
+    first++; // Evict the oldest entry; its bytes go at the next compaction
+    history_count--;
+  }
+  if (reserve_store(len + 1, 1) != 0)
+    return;
+  entry_off[first + history_count++] = store_len;
+  memcpy(store + store_len, command, len);
+  store[store_len + len] = '\0';
+  store_len += len + 1;
+}
+
+static void unmap_history(void) {
+  if (history_map)
+    munmap(history_map, history_map_len);
+  history_map = NULL;
+  history_map_len = 0;
+}
+
+static void map_history(void) {
+  struct stat st;
+  unmap_history();
+  if (history_fd < 0 || fstat(history_fd, &st) != 0 || st.st_size == 0)
+    return;
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, history_fd, 0);
+  if (map == MAP_FAILED) {
+    perror("history: mmap");
+    return;
+  }
+  history_map = map;
+  history_map_len = st.st_size;
+}
+
+// Pick up entries appended since the file was mapped at startup
+static void remap_history(void) {
+  struct stat st;
+  if (history_fd >= 0 && fstat(history_fd, &st) == 0 &&
+      (size_t)st.st_size != history_map_len)
+    map_history();
+}
+
+// Start of the region holding the last max lines of buf[0, len)
+static size_t tail_start(const char *buf, size_t len, size_t max) {
+  size_t end = len;
+  if (end > 0 && buf[end - 1] == '\n')
+    end--;
+  size_t lines = 0;
+  while (end > 0) {
+    if (buf[end - 1] == '\n' && ++lines == max)
+      return end;
+    end--;
+  }
+  return 0;
+}
+
+// Replace the file with the lines we actually keep
+static void rewrite_history_file(const char *data, size_t len) {
+  char tmp[PATH_MAX + 16];
+  snprintf(tmp, sizeof(tmp), "%s.%d", history_path, (int)getpid());
+
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (fd < 0)
+    return;
+  if (write(fd, data, len) != (ssize_t)len || rename(tmp, history_path) != 0) {
+    close(fd);
+    unlink(tmp);
+    return;
+  }
+  close(fd);
+  fd = open(history_path, O_RDWR | O_APPEND | O_CLOEXEC);
+  if (fd >= 0) {
+    close(history_fd);
+    history_fd = fd;
+  }
+}
+
+// Index the tail of the history file the first time the history is read
+static void load_history(void) {
+  if (history_loaded)
+    return;
+  history_loaded = 1;
+
+  remap_history();
+  if (history_map) {
+    size_t start = tail_start(history_map, history_map_len, history_max);
+    const char *tail = history_map + start;
+    size_t len = history_map_len - start;
+    size_t lines = 0;
+    for (const char *p = tail; p < tail + len; lines++) {
+      const char *nl = memchr(p, '\n', tail + len - p);
+      p = nl ? nl + 1 : tail + len;
+    }
+    // One copy of the whole tail, then index it in place
+    if (reserve_store(len + 1, lines) == 0) {
+      memcpy(store, tail, len);
+      store_len = len;
+      if (len > 0 && store[len - 1] != '\n')
+        store[store_len++] = '\n';
+      char *p = store;
+      while (p < store + store_len) {
+        char *nl = memchr(p, '\n', store + store_len - p);
+        *nl = '\0';
+        entry_off[history_count++] = p - store;
+        p = nl + 1;
+      }
+      // Keep the file from growing without bound
+      if (start > len && getpid() == history_owner)
+        rewrite_history_file(history_map + start, len);
+    }
+    unmap_history();
+  }
+  free(last_entry);
+  last_entry = NULL;
+}
+
+void init_history() {
+  const char *env = getenv("HISTSIZE");
+  if (env) {
+    char *end;
+    unsigned long n = strtoul(env, &end, 10);
+    if (*end == '\0' && n > 0)
+      history_max = n;
+  }
+
+  const char *file = getenv("HISTFILE");
+  const char *home = getenv("HOME");
+  history_loaded = 1; // Nothing to load unless the file can be mapped
+  if (file) {
+    if (*file == '\0')
+      return; // HISTFILE= disables the history file
+    snprintf(history_path, sizeof(history_path), "%s", file);
+  } else if (home) {
+    snprintf(history_path, sizeof(history_path), "%s/%s", home,
+             HISTORY_FILE_NAME);
+  } else {
+    return;
+  }
+
+  history_fd =
+      open(history_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+  if (history_fd < 0)
+    return;
+  history_owner = getpid();
+  history_loaded = 0;
+
+  // Mapping costs the same for any file size; pages are only touched
+  // when the history is first read
+  map_history();
+  if (history_map) {
+    size_t end = history_map_len;
+    if (history_map[end - 1] == '\n')
+      end--;
+    size_t start = end;
+    while (start > 0 && history_map[start - 1] != '\n')
+      start--;
+    last_entry = strndup(history_map + start, end - start);
+  }
+}
+
+void add_to_history(const char *command) {
+  const char *last = last_entry;
+  if (history_loaded)
+    last = history_count ? store + entry_off[first + history_count - 1] : NULL;
+  if (last && strcmp(last, command) == 0) {
+    return; // Don't add duplicate consecutive commands
+  }
+
+  size_t len = strlen(command);
+  if (history_fd >= 0) {
+    struct iovec iov[2] = {{(void *)command, len}, {"\n", 1}};
+    if (writev(history_fd, iov, 2) < 0) {
+      perror("history");
+    }
+  }
+
+  if (history_loaded) {
+    store_append(command, len);
+  } else {
+    free(last_entry);
+    last_entry = strdup(command);
+  }
+}
+
+void clear_history() {
+  unmap_history();
+  free(last_entry);
+  last_entry = NULL;
+  history_loaded = 1;
+  store_len = 0;
+  first = 0;
+  history_count = 0;
+  if (history_fd >= 0 && ftruncate(history_fd, 0) != 0)
+    perror("history");
+}
+
+size_t history_length(void) {
+  load_history();
+  return history_count;
+}
+
+const char *history_entry(size_t n) {
+  load_history();
+  if (n == 0 || n > history_count)
+    return NULL;
+  return store + entry_off[first + n - 1];
+}
+
+// Newest entry, without indexing the file if it is not loaded yet
+static const char *newest_entry(void) {
+  if (!history_loaded)
+    return last_entry;
+  return history_count ? store + entry_off[first + history_count - 1] : NULL;
+}
+
+int expand_history(const char *line, char **expanded) {
+  if (!strchr(line, '!'))
+    return 0;
+
+  char *out = NULL;
+  size_t out_len = 0;
+  FILE *fp = open_memstream(&out, &out_len);
+  if (!fp) {
+    perror("open_memstream");
+    return -1;
+  }
+
+  int changed = 0;
+  const char *p = line;
+  while (*p) {
+    const char *event = NULL;
+    const char *end = p + 1;
+    if (p[0] == '!' && p[1] == '!') {
+      event = newest_entry();
+      end = p + 2;
+    } else if (p[0] == '!' &&
+               (isdigit((unsigned char)p[1]) ||
+                (p[1] == '-' && isdigit((unsigned char)p[2])))) {
+      char *num_end;
+      long n = strtol(p + 1, &num_end, 10);
+      size_t count = history_length();
+      if (n < 0)
+        n += (long)count + 1; // !-n counts back from the newest
+      event = n > 0 ? history_entry((size_t)n) : NULL;
+      end = num_end;
+    } else {
+      fputc(*p++, fp);
+      continue;
+    }
+    if (!event) {
+      fclose(fp);
+      free(out);
+      fprintf(stderr, "%.*s: event not found\n", (int)(end - p), p);
+      return -1;
+    }
+    fputs(event, fp);
+    changed = 1;
+    p = end;
+  }
+
+  fclose(fp);
+  if (!changed) {
+    free(out);
+    return 0;
+  }
+  *expanded = out;
+  return 1;
+}
+
+void display_history() {
+  load_history();
+  size_t start = (history_count > 10) ? history_count - 10 : 0;
+  for (size_t i = start; i < history_count; ++i) {
+    printf("%zu: %s\n", i + 1, store + entry_off[first + i]);
+  }
+}
+
+int save_history(const char *filename) {
+  load_history();
+  FILE *fp = fopen(filename, "w");
+  if (!fp) {
+    perror("log -s");
+    return 1;
+  }
+  for (size_t i = 0; i < history_count; ++i) {
+    fprintf(fp, "%s\n", store + entry_off[first + i]);
+  }
+  fclose(fp);
+  return 0;
+}
+
+// Print every entry of buf[0, len) holding pattern, numbered from 1.
+// Entries end in sep, which a pattern never contains, so a match cannot
+// straddle two of them.
+static size_t search_entries(const char *buf, size_t len, char sep,
+                             const char *pattern, size_t plen) {
+  const char *end = buf + len;
+  const char *entry = buf; // Start of entry n
+  const char *p = buf;
+  size_t n = 1, matches = 0;
+  while ((p = memmem(p, end - p, pattern, plen)) != NULL) {
+    const char *next;
+    while ((next = memchr(entry, sep, p - entry)) != NULL) {
+      entry = next + 1;
+      n++;
+    }
+    const char *stop = memchr(p, sep, end - p);
+    if (!stop)
+      stop = end; // Last line of a file without a final newline
+    printf("%zu: %.*s\n", n, (int)(stop - entry), entry);
+    matches++;
+    if (stop == end)
+      break;
+    entry = p = stop + 1; // Report each entry once
+    n++;
+  }
+  return matches;
+}
+
+size_t search_history(const char *pattern) {
+  size_t plen = strlen(pattern);
+  if (plen == 0)
+    return 0;
+
+  // Until an entry itself is needed, search the mapped file in place
+  // rather than copying it into the store first
+  if (!history_loaded) {
+    remap_history();
+    if (!history_map)
+      return 0;
+    size_t start = tail_start(history_map, history_map_len, history_max);
+    return search_entries(history_map + start, history_map_len - start,
+                          '\n', pattern, plen);
+  }
+
+  if (history_count == 0)
+    return 0;
+  return search_entries(store + entry_off[first],
+                        store_len - entry_off[first], '\0', pattern, plen);
+}
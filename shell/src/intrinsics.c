@@ -1,70 +1,15 @@
 #define _POSIX_C_SOURCE 200809L // Expose POSIX function declarations
 #include "../include/intrinsics.h"
+#include "../include/astcache.h"
+#include "../include/complete.h"
+#include "../include/history.h"
+#include "../include/io.h"
 #include "../include/jobs.h"
+#include "../include/launch.h"
+#include "../include/pathcache.h"
+#include "../include/vars.h"
 #include <limits.h> // For PATH_MAX
 
-// Helper function for qsort to compare two strings
-static int compare_strings(const void *a, const void *b) {
-  return strcmp(*(const char **)a, *(const char **)b);
-}
-
-// History storage
-static char *history[MAX_HISTORY];
-static int history_count = 0;
-static int history_start = 0;
-
-void init_history() {
-  for (int i = 0; i < MAX_HISTORY; ++i)
-    history[i] = NULL;
-}
-
-void add_to_history(const char *command) {
-  if (history_count > 0 &&
-      strcmp(history[(history_start + history_count - 1) % MAX_HISTORY],
-             command) == 0) {
-    return; // Don't add duplicate consecutive commands
-  }
-  if (history_count == MAX_HISTORY) {
-    free(history[history_start]);
-    history_start = (history_start + 1) % MAX_HISTORY;
-    history_count--;
-  }
-  int index = (history_start + history_count) % MAX_HISTORY;
-  history[index] = strdup(command);
-  history_count++;
-}
-
-void clear_history() {
-  for (int i = 0; i < history_count; ++i) {
-    free(history[(history_start + i) % MAX_HISTORY]);
-    history[(history_start + i) % MAX_HISTORY] = NULL;
-  }
-  history_count = 0;
-  history_start = 0;
-}
-
-void display_history() {
-  int start = (history_count > 10) ? history_count - 10 : 0;
-  for (int i = start; i < history_count; ++i) {
-    int index = (history_start + i) % MAX_HISTORY;
-    printf("%d: %s\n", i + 1, history[index]);
-  }
-}
-
-int save_history(const char *filename) {
-  FILE *fp = fopen(filename, "w");
-  if (!fp) {
-    perror("log -s");
-    return 1;
-  }
-  for (int i = 0; i < history_count; ++i) {
-    int index = (history_start + i) % MAX_HISTORY;
-    fprintf(fp, "%s\n", history[index]);
-  }
-  fclose(fp);
-  return 0;
-}
-
 int builtin_log(char **args) {
   if (args[1] == NULL) {
     display_history();
@@ -76,6 +21,12 @@ int builtin_log(char **args) {
       return 1;
     }
     return save_history(args[2]);
+  } else if (strcmp(args[1], "-f") == 0) {
+    if (args[2] == NULL) {
+      fprintf(stderr, "log -f: missing pattern\n");
+      return 1;
+    }
+    return search_history(args[2]) > 0 ? 0 : 1;
   } else {
     fprintf(stderr, "log: invalid option %s\n", args[1]);
     return 1;
@@ -124,6 +75,8 @@ int builtin_hop(char **args) {
     perror("hop");
     return 1;
   }
+  invalidate_prompt();
+  complete_invalidate_dirs(); // Relative listings are stale now
 
   strcpy(prev_dir, temp_dir_for_prev);
 
@@ -135,114 +88,136 @@ int builtin_hop(char **args) {
   return 0;
 }
 
-int builtin_reveal(char **args) {
-  int show_hidden = 0;
-  int long_format = 0;
-  char *target_dir = ".";
-
-  // --- 1. Parse arguments and flags ---
-  for (int i = 1; args[i] != NULL; ++i) {
-    if (args[i][0] == '-') {
-      for (size_t j = 1; j < strlen(args[i]); ++j) {
-        if (args[i][j] == 'a')
-          show_hidden = 1;
-        else if (args[i][j] == 'l')
-          long_format = 1;
-        else {
-          fprintf(stderr, "reveal: invalid option -- '%c'\n", args[i][j]);
-          return 1;
-        }
-      }
-    } else {
-      target_dir = args[i];
-    }
-  }
-
-  DIR *dir = opendir(target_dir);
-  if (!dir) {
-    perror("reveal");
+int builtin_ping(char **args) {
+  if (args[1] == NULL || args[2] == NULL) {
+    fprintf(stderr, "Usage: ping <pid> <signal>\n");
     return 1;
   }
-
-  // --- 2. Read entries into a dynamic array ---
-  char **entries = NULL;
-  size_t count = 0;
-  size_t capacity = 16; // Initial capacity
-  entries = malloc(capacity * sizeof(char *));
-  if (!entries) {
-    perror("malloc");
-    closedir(dir);
+  pid_t pid = atoi(args[1]);
+  int sig = atoi(args[2]);
+  if (kill(pid, sig) != 0) {
+    perror("ping");
     return 1;
   }
+  return 0;
+}
 
-  struct dirent *entry;
-  while ((entry = readdir(dir)) != NULL) {
-    if (!show_hidden && entry->d_name[0] == '.') {
-      continue;
-    }
-    if (count >= capacity) {
-      capacity *= 2;
-      char **new_entries = realloc(entries, capacity * sizeof(char *));
-      if (!new_entries) {
-        perror("realloc");
-        // Free existing memory before failing
-        for (size_t i = 0; i < count; i++)
-          free(entries[i]);
-        free(entries);
-        closedir(dir);
-        return 1;
-      }
-      entries = new_entries;
+// A job with its resource totals, for sorting and verbose listing
+typedef struct {
+  Job *job;
+  double cpu_seconds;
+  long rss_kib;
+} JobUsage;
+
+typedef enum { SORT_NONE, SORT_CPU, SORT_MEM } ActivitySort;
+
+static int compare_cpu(const void *a, const void *b) {
+  double x = ((const JobUsage *)a)->cpu_seconds;
+  double y = ((const JobUsage *)b)->cpu_seconds;
+  return (x < y) - (x > y); // Largest first
+}
+
+static int compare_mem(const void *a, const void *b) {
+  long x = ((const JobUsage *)a)->rss_kib;
+  long y = ((const JobUsage *)b)->rss_kib;
+  return (x < y) - (x > y); // Largest first
+}
+
+static void sum_job_usage(JobUsage *u) {
+  ProcessSample sample;
+  u->cpu_seconds = 0;
+  u->rss_kib = 0;
+  for (int i = 0; i < u->job->proc_count; i++) {
+    if (sample_process(&u->job->procs[i], &sample) == 0) {
+      u->cpu_seconds += sample.cpu_seconds;
+      u->rss_kib += sample.rss_kib;
     }
-    entries[count++] = strdup(entry->d_name);
   }
-  closedir(dir);
-
-  // --- 3. Sort the array ---
-  qsort(entries, count, sizeof(char *), compare_strings);
+}
 
-  // --- 4. Print the sorted entries ---
-  for (size_t i = 0; i < count; i++) {
-    printf("%s%s", entries[i], long_format ? "\n" : "  ");
+static void print_activity(const JobUsage *u, int verbose,
+                           const struct timespec *now) {
+  Job *job = u->job;
+  const char *status_str = "Running";
+  if (job->status == JOB_STOPPED) {
+    status_str = "Stopped";
+  } else if (job->status == JOB_QUEUED) {
+    status_str = "Queued";
   }
-  if (!long_format && count > 0) {
-    printf("\n");
+  // A queued job has no process group yet
+  char pgid[16] = "-";
+  if (job->status != JOB_QUEUED)
+    snprintf(pgid, sizeof(pgid), "%d", (int)job->pgid);
+  if (!verbose) {
+    printf("[%d] %s %s %s\n", job->job_id, pgid, status_str, job->command);
+    return;
   }
 
-  // --- 5. Free all allocated memory ---
-  for (size_t i = 0; i < count; i++) {
-    free(entries[i]);
+  long elapsed = now->tv_sec - job->start.tv_sec;
+  printf("[%d] %s %s %ld:%02ld:%02ld cpu %.2fs rss %ld KiB %s\n",
+         job->job_id, pgid, status_str, elapsed / 3600,
+         elapsed / 60 % 60, elapsed % 60, u->cpu_seconds, u->rss_kib,
+         job->command);
+  for (int i = 0; i < job->proc_count; i++) {
+    ProcessSample sample;
+    sample_process(&job->procs[i], &sample);
+    printf("    %d %c cpu %.2fs rss %ld KiB %s\n", (int)job->procs[i].pid,
+           sample.state, sample.cpu_seconds, sample.rss_kib, sample.name);
   }
-  free(entries);
+}
 
-  return 0;
+// The foreground job is the pipeline activities itself is running in
+static int is_listed(const Job *job) {
+  return job->is_background || job->status != JOB_RUNNING;
 }
 
-int builtin_ping(char **args) {
-  if (args[1] == NULL || args[2] == NULL) {
-    fprintf(stderr, "Usage: ping <pid> <signal>\n");
-    return 1;
+int builtin_activities(char **args) {
+  int verbose = 0;
+  ActivitySort sort = SORT_NONE;
+  for (int i = 1; args[i] != NULL; i++) {
+    if (strcmp(args[i], "-v") == 0) {
+      verbose = 1;
+    } else if (strcmp(args[i], "-s") == 0 && args[i + 1] != NULL &&
+               (strcmp(args[i + 1], "cpu") == 0 ||
+                strcmp(args[i + 1], "mem") == 0)) {
+      sort = args[++i][0] == 'c' ? SORT_CPU : SORT_MEM;
+    } else {
+      fprintf(stderr, "Usage: activities [-v] [-s cpu|mem]\n");
+      return 1;
+    }
   }
-  pid_t pid = atoi(args[1]);
-  int sig = atoi(args[2]);
-  if (kill(pid, sig) != 0) {
-    perror("ping");
+
+  size_t count = 0;
+  for (Job *job = first_job(); job; job = job->next)
+    count += is_listed(job);
+  if (count == 0)
+    return 0;
+  JobUsage *jobs = malloc(count * sizeof(*jobs));
+  if (!jobs) {
+    perror("malloc");
     return 1;
   }
-  return 0;
-}
 
-int builtin_activities(char **args) {
-  for (int i = 0; i < MAX_JOBS; ++i) {
-    if (job_table[i].pgid != 0) {
-      const char *status_str = "Running";
-      if (job_table[i].status == JOB_STOPPED) {
-        status_str = "Stopped";
-      }
-      printf("[%d] %d %s %s\n", job_table[i].job_id, job_table[i].pgid,
-             status_str, job_table[i].command);
-    }
+  // /proc is only read when the figures are shown or sorted on
+  size_t n = 0;
+  for (Job *job = first_job(); job; job = job->next) {
+    if (!is_listed(job))
+      continue;
+    jobs[n].job = job;
+    if (verbose || sort != SORT_NONE)
+      sum_job_usage(&jobs[n]);
+    n++;
   }
+  if (sort == SORT_CPU)
+    qsort(jobs, n, sizeof(*jobs), compare_cpu);
+  else if (sort == SORT_MEM)
+    qsort(jobs, n, sizeof(*jobs), compare_mem);
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  for (size_t i = 0; i < n; i++)
+    print_activity(&jobs[i], verbose, &now);
+  free(jobs);
   return 0;
 }
 
@@ -257,27 +232,25 @@ int builtin_fg(char **args) {
     fprintf(stderr, "fg: job not found: %d\n", job_id);
     return 1;
   }
-
-  g_fg_pgid = job->pgid;
-  tcsetpgrp(STDIN_FILENO, g_fg_pgid);
-
-  if (job->status == JOB_STOPPED) {
-    kill(-job->pgid, SIGCONT);
+  if (job->status == JOB_QUEUED) {
+    start_queued_job(job); // Jumps the queue
+    if (job->status != JOB_RUNNING)
+      return 1;
   }
 
-  int status;
-  waitpid(job->pgid, &status, WUNTRACED);
+  if (g_interactive)
+    tcsetpgrp(STDIN_FILENO, job->pgid);
 
-  if (WIFSTOPPED(status)) {
-    update_job_status(job->pgid, WSTOPSIG(status));
-    print_job_status(job, 0);
-  } else {
-    remove_job(job->pgid);
+  JobStatus status = job->status;
+  if (status == JOB_STOPPED) {
+    kill(-job->pgid, SIGCONT);
+    status = JOB_RUNNING;
   }
 
-  g_fg_pgid = 0;
-  tcsetpgrp(STDIN_FILENO, getpgrp());
-  return 0;
+  set_job_state(job, status, 0);
+  start_queued_jobs(); // It no longer holds a background slot
+  wait_for_job(job);
+  return g_last_status;
 }
 
 int builtin_bg(char **args) {
@@ -291,23 +264,199 @@ int builtin_bg(char **args) {
     fprintf(stderr, "bg: job not found: %d\n", job_id);
     return 1;
   }
+  if (job->status == JOB_QUEUED) {
+    start_queued_job(job); // Jumps the queue
+    if (job->status != JOB_RUNNING)
+      return 1;
+    print_job_status(job, 0);
+    return 0;
+  }
   if (job->status != JOB_STOPPED) {
     fprintf(stderr, "bg: job %d is already running\n", job_id);
     return 1;
   }
 
   kill(-job->pgid, SIGCONT);
-  job->status = JOB_RUNNING;
+  set_job_state(job, JOB_RUNNING, 1); // Report it when it finishes
   print_job_status(job, 0);
   return 0;
 }
 
 int builtin_exit(char **args) {
-  (void)args; // Suppress unused parameter warning
-  exit(0);
+  // exit [n]: defaults to the status of the last command
+  int status = args[1] ? atoi(args[1]) : g_last_status;
+  exit(status & 0xff);
   return 0; // Unreachable
 }
 
+int builtin_hash(char **args) {
+  if (args[1] == NULL) {
+    path_cache_print();
+    return 0;
+  }
+  if (strcmp(args[1], "-r") == 0) {
+    path_cache_clear();
+    return 0;
+  }
+  if (strcmp(args[1], "-s") == 0) {
+    unsigned long hits, misses;
+    path_cache_stats(&hits, &misses);
+    printf("hash: %lu hits, %lu misses\n", hits, misses);
+    return 0;
+  }
+  int ret = 0;
+  for (int i = 1; args[i] != NULL; ++i) {
+    if (path_cache_add(args[i]) != 0) {
+      fprintf(stderr, "hash: %s: not found\n", args[i]);
+      ret = 1;
+    }
+  }
+  return ret;
+}
+
+int builtin_parsecache(char **args) {
+  if (args[1] != NULL && strcmp(args[1], "-c") == 0) {
+    ast_cache_clear();
+    return 0;
+  }
+  if (args[1] != NULL) {
+    fprintf(stderr, "Usage: parsecache [-c]\n");
+    return 1;
+  }
+  unsigned long hits, misses;
+  size_t entries;
+  ast_cache_stats(&hits, &misses, &entries);
+  printf("parsecache: %lu hits, %lu misses, %zu/%d lines cached\n", hits,
+         misses, entries, AST_CACHE_SIZE);
+  return 0;
+}
+
+int builtin_launcher(char **args) {
+  if (args[1] == NULL) {
+    printf("%s\n", g_launch_mode == LAUNCH_SPAWN ? "spawn" : "fork");
+  } else if (strcmp(args[1], "spawn") == 0) {
+    g_launch_mode = LAUNCH_SPAWN;
+  } else if (strcmp(args[1], "fork") == 0) {
+    g_launch_mode = LAUNCH_FORK;
+  } else {
+    fprintf(stderr, "Usage: launcher [fork|spawn]\n");
+    return 1;
+  }
+  return 0;
+}
+
+// bglimit [N]: show or set how many background jobs may run at once, 0
+// for no limit. Raising it starts queued jobs right away.
+int builtin_bglimit(char **args) {
+  if (args[1] == NULL) {
+    if (g_bg_limit > 0)
+      printf("%d\n", g_bg_limit);
+    else
+      printf("unlimited\n");
+    return 0;
+  }
+  char *end;
+  long limit = strtol(args[1], &end, 10);
+  if (end == args[1] || *end || limit < 0 || limit > INT_MAX || args[2]) {
+    fprintf(stderr, "Usage: bglimit [N]\n");
+    return 1;
+  }
+  g_bg_limit = (int)limit;
+  start_queued_jobs();
+  return 0;
+}
+
+// wait [-n | %n...]: block until background jobs finish. With no
+// arguments waits for all of them and returns 0; with job ids waits for
+// each and returns the last one's status; -n returns the status of
+// whichever job finishes first. Jobs collected here are not reported as
+// Done afterwards.
+int builtin_wait(char **args) {
+  Job *done;
+  int rc;
+  if (args[1] && strcmp(args[1], "-n") == 0) {
+    if (args[2]) {
+      fprintf(stderr, "Usage: wait [-n | %%job...]\n");
+      return 2;
+    }
+    rc = wait_background(NULL, &done);
+    if (rc != 0)
+      return rc < 0 ? 130 : 127;
+    int status = job_exit_status(done);
+    delete_job(done);
+    return status;
+  }
+
+  if (!args[1]) {
+    while ((rc = wait_background(NULL, &done)) == 0)
+      delete_job(done);
+    return rc < 0 ? 130 : 0;
+  }
+
+  int status = 0;
+  for (int i = 1; args[i]; i++) {
+    const char *spec = args[i][0] == '%' ? args[i] + 1 : args[i];
+    char *end;
+    long job_id = strtol(spec, &end, 10);
+    Job *job = end != spec && !*end ? get_job_by_id(job_id) : NULL;
+    if (!job) {
+      fprintf(stderr, "wait: job not found: %s\n", args[i]);
+      status = 127;
+      continue;
+    }
+    rc = wait_background(job, &done);
+    if (rc < 0)
+      return 130;
+    if (rc > 0) {
+      fprintf(stderr, "wait: job %d is stopped\n", job->job_id);
+      status = 1;
+      continue;
+    }
+    status = job_exit_status(done);
+    delete_job(done);
+  }
+  return status;
+}
+
+// pipestatus: exit status of each stage of the last foreground pipeline
+int builtin_pipestatus(char **args) {
+  (void)args;
+  const int *codes;
+  int count = get_pipestatus(&codes);
+  for (int i = 0; i < count; i++)
+    printf(i ? " %d" : "%d", codes[i]);
+  printf("\n");
+  return 0;
+}
+
+// export [NAME[=value]...]: put variables in the environment of commands
+// started from now on. With no arguments lists the exported variables.
+int builtin_export(char **args) {
+  if (args[1] == NULL) {
+    vars_print_exported();
+    return 0;
+  }
+  int status = 0;
+  for (int i = 1; args[i]; i++) {
+    char *eq = strchr(args[i], '=');
+    char *name = eq ? strndup(args[i], eq - args[i]) : args[i];
+    if (!name || vars_export(name, eq ? eq + 1 : NULL) != 0) {
+      fprintf(stderr, "export: `%s': not a valid identifier\n", args[i]);
+      status = 1;
+    }
+    if (eq)
+      free(name);
+  }
+  return status;
+}
+
+// unset NAME...: remove shell variables, and from the environment
+int builtin_unset(char **args) {
+  for (int i = 1; args[i]; i++)
+    vars_unset(args[i]);
+  return 0;
+}
+
 static const BuiltinCommand builtins[] = {{"hop", builtin_hop},
                                           {"reveal", builtin_reveal},
                                           {"log", builtin_log},
@@ -316,6 +465,16 @@ static const BuiltinCommand builtins[] = {{"hop", builtin_hop},
                                           {"fg", builtin_fg},
                                           {"bg", builtin_bg},
                                           {"exit", builtin_exit},
+                                          {"hash", builtin_hash},
+                                          {"launcher", builtin_launcher},
+                                          {"parsecache", builtin_parsecache},
+                                          {"parallel", builtin_parallel},
+                                          {"bglimit", builtin_bglimit},
+                                          {"wait", builtin_wait},
+                                          {"pipestatus", builtin_pipestatus},
+                                          {"cat", builtin_cat},
+                                          {"export", builtin_export},
+                                          {"unset", builtin_unset},
                                           {NULL, NULL}};
 
 // NEW: Helper function to identify commands that MUST run in the parent
@@ -324,7 +483,40 @@ int is_parent_builtin(const char *cmd_name) {
   if (cmd_name == NULL)
     return 0;
   return strcmp(cmd_name, "hop") == 0 || strcmp(cmd_name, "exit") == 0 ||
-         strcmp(cmd_name, "fg") == 0 || strcmp(cmd_name, "bg") == 0;
+         strcmp(cmd_name, "fg") == 0 || strcmp(cmd_name, "bg") == 0 ||
+         strcmp(cmd_name, "bglimit") == 0 || strcmp(cmd_name, "wait") == 0 ||
+         strcmp(cmd_name, "export") == 0 || strcmp(cmd_name, "unset") == 0;
+}
+
+int is_streaming_builtin(const char *cmd_name) {
+  if (cmd_name == NULL)
+    return 0;
+  return strcmp(cmd_name, "cat") == 0 || strcmp(cmd_name, "parallel") == 0;
+}
+
+int needs_own_process(const char *cmd_name) {
+  return cmd_name != NULL && strcmp(cmd_name, "parallel") == 0;
+}
+
+int runs_as_builtin(CommandNode *cmd, int in_fd) {
+  return cmd->arg_count > 0 && is_builtin(cmd->args[0]) &&
+         !cat_needs_external(cmd, in_fd);
+}
+
+int is_builtin(const char *name) {
+  if (name == NULL)
+    return 0;
+  for (int i = 0; builtins[i].name; i++) {
+    if (strcmp(name, builtins[i].name) == 0)
+      return 1;
+  }
+  return 0;
+}
+
+const char *builtin_name(int i) {
+  if (i < 0 || i >= (int)(sizeof(builtins) / sizeof(builtins[0])))
+    return NULL;
+  return builtins[i].name;
 }
 
 int handle_builtin(CommandNode *cmd) {
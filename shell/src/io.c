@@ -1,45 +1,164 @@
 #include "../include/io.h"
+#include "../include/lineedit.h"
 #include "../include/shell.h"
+#include <sys/mman.h>
 
-void display_prompt(void) {
-  char hostname[HOST_NAME_MAX];
-  char cwd[PATH_MAX];
+// The prompt is rendered once and reused until the directory changes.
+// User and host name never change, so they are looked up only once.
+static char prompt_user[LOGIN_NAME_MAX + 1];
+static char prompt_host[HOST_NAME_MAX + 1];
+static int prompt_ids_resolved = 0;
+static char prompt[LOGIN_NAME_MAX + HOST_NAME_MAX + PATH_MAX + 8];
+static size_t prompt_len = 0;
+static int prompt_valid = 0;
+
+static void resolve_prompt_ids(void) {
   char *username = getlogin();
 
   // --- Get system info ---
-  if (gethostname(hostname, sizeof(hostname)) != 0) {
+  if (gethostname(prompt_host, sizeof(prompt_host)) != 0) {
     perror("gethostname");
-    strcpy(hostname, "localhost");
+    strcpy(prompt_host, "localhost");
   }
+  prompt_host[sizeof(prompt_host) - 1] = '\0';
   if (!username) {
     struct passwd *pw = getpwuid(getuid());
     username = pw ? pw->pw_name : "user";
   }
+  snprintf(prompt_user, sizeof(prompt_user), "%s", username);
+  prompt_ids_resolved = 1;
+}
+
+static void render_prompt(void) {
+  char cwd[PATH_MAX];
+
+  if (!prompt_ids_resolved)
+    resolve_prompt_ids();
   if (getcwd(cwd, sizeof(cwd)) == NULL) {
     perror("getcwd");
     strcpy(cwd, "");
   }
 
   // --- Format the path with tilde replacement ---
-  char display_path[PATH_MAX];
+  const char *tilde = "";
+  const char *path = cwd;
   size_t home_len = strlen(g_shell_home_dir);
 
   // Check if the current path is the shell's home directory or a subdirectory
-  if (strncmp(cwd, g_shell_home_dir, home_len) == 0) {
-    // Check for exact match or ancestor directory
-    if (cwd[home_len] == '/' || cwd[home_len] == '\0') {
-      snprintf(display_path, sizeof(display_path), "~%s", cwd + home_len);
-    } else {
-      // Not a true ancestor (e.g., home is /usr/user, cwd is /usr/username)
-      strncpy(display_path, cwd, sizeof(display_path));
-    }
-  } else {
-    // Current path is not a descendant of shell's home, show absolute path
-    strncpy(display_path, cwd, sizeof(display_path));
+  // (not just a prefix, e.g. home is /usr/user and cwd is /usr/username)
+  if (strncmp(cwd, g_shell_home_dir, home_len) == 0 &&
+      (cwd[home_len] == '/' || cwd[home_len] == '\0')) {
+    tilde = "~";
+    path = cwd + home_len;
   }
-  display_path[sizeof(display_path) - 1] = '\0'; // Ensure null termination
+
+  int n = snprintf(prompt, sizeof(prompt), "<%s@%s:%s%s> ", prompt_user,
+                   prompt_host, tilde, path);
+  prompt_len = n < 0 ? 0 : ((size_t)n < sizeof(prompt) ? (size_t)n
+                                                        : sizeof(prompt) - 1);
+  prompt_valid = 1;
+}
+
+void invalidate_prompt(void) { prompt_valid = 0; }
+
+const char *prompt_text(size_t *len) {
+  if (!prompt_valid)
+    render_prompt();
+  *len = prompt_len;
+  return prompt;
+}
+
+void display_prompt(void) {
+  if (!prompt_valid)
+    render_prompt();
 
   // --- Print the final prompt ---
-  printf("<%s@%s:%s> ", username, hostname, display_path);
-  fflush(stdout);
+  fflush(stdout); // Keep ordering with anything still buffered in stdio
+  if (write(STDOUT_FILENO, prompt, prompt_len) < 0) {
+    perror("write");
+  }
+}
+
+// Large stdio buffer for non-interactive stdin
+#define STREAM_BUFFER_SIZE (64 * 1024)
+
+void line_source_from_stream(LineSource *src, FILE *stream) {
+  memset(src, 0, sizeof(*src));
+  src->stream = stream;
+  if (!isatty(fileno(stream)))
+    setvbuf(stream, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+}
+
+void line_source_from_string(LineSource *src, const char *str) {
+  memset(src, 0, sizeof(*src));
+  src->data = str;
+  src->len = strlen(str);
+}
+
+int line_source_from_file(LineSource *src, const char *path) {
+  struct stat st;
+  memset(src, 0, sizeof(*src));
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return -1;
+  }
+  src->data = "";
+  if (st.st_size > 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+      close(fd);
+      return -1;
+    }
+    src->data = map;
+    src->len = st.st_size;
+    src->mapped = 1;
+  }
+  close(fd);
+  return 0;
+}
+
+void line_source_close(LineSource *src) {
+  if (src->mapped)
+    munmap((void *)src->data, src->len);
+  free(src->line);
+  memset(src, 0, sizeof(*src));
+}
+
+ssize_t line_source_next(LineSource *src) {
+  ssize_t len;
+  if (src->edit) {
+    size_t prompt_len = src->prompt ? strlen(src->prompt) : 0;
+    const char *prompt =
+        src->prompt ? src->prompt : prompt_text(&prompt_len);
+    return line_edit(prompt, prompt_len, &src->line, &src->line_cap);
+  }
+  if (!src->data) {
+    // getline grows the buffer, so long lines are never cut off
+    len = getline(&src->line, &src->line_cap, src->stream);
+    if (len > 0 && src->line[len - 1] == '\n')
+      src->line[--len] = '\0'; // Remove trailing newline
+    return len;
+  }
+
+  if (src->pos >= src->len)
+    return -1;
+  const char *start = src->data + src->pos;
+  const char *nl = memchr(start, '\n', src->len - src->pos);
+  size_t n = nl ? (size_t)(nl - start) : src->len - src->pos;
+  src->pos += n + (nl != NULL);
+  if (n + 1 > src->line_cap) {
+    char *grown = realloc(src->line, n + 1);
+    if (!grown) {
+      perror("realloc");
+      return -1;
+    }
+    src->line = grown;
+    src->line_cap = n + 1;
+  }
+  memcpy(src->line, start, n);
+  src->line[n] = '\0';
+  return n;
 }
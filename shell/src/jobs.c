@@ -1,256 +1,1208 @@
+#define _GNU_SOURCE // wait4
 #include "../include/jobs.h"
 #include "../include/intrinsics.h"
+#include "../include/launch.h"
+#include "../include/pathcache.h"
+#include "../include/vars.h"
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+
+#define JOB_SLAB_SIZE 256
+#define JOB_INITIAL_BUCKETS 64
 
 // Globals for job management
-Job job_table[MAX_JOBS];
 int next_job_id = 1;
+int g_bg_limit = 0;
 extern pid_t g_fg_pgid;
 
+static Job **job_slabs = NULL; // Backing storage, never moved or freed
+static size_t job_slab_count = 0;
+static Job *free_jobs = NULL; // Unused slots, linked through next
+static Job *job_head = NULL, *job_tail = NULL;
+static size_t job_count = 0;
+static int running_background = 0; // Kept current by set_job_state
+
+// Hash indexes on job_id and pgid; both share one bucket count
+static Job **id_buckets = NULL;
+static Job **pgid_buckets = NULL;
+static size_t bucket_count = 0;
+
+// Jobs whose state changed and that the user has not been told about
+static Job *notify_head = NULL, *notify_tail = NULL;
+static int pending_notifications = 0;
+
+// Background jobs waiting for a slot, oldest first
+static Job *queue_head = NULL, *queue_tail = NULL;
+
+// Exit status of every stage of the last foreground pipeline
+static int *pipestatus = NULL;
+static int pipestatus_count = 0;
+static unsigned long pipestatus_serial = 0; // Bumped on every update
+
+static size_t hash_int(int key) {
+  unsigned int h = (unsigned int)key * 2654435761u;
+  return (h ^ (h >> 16)) & (bucket_count - 1);
+}
+
+static int grow_slabs(void) {
+  Job **slabs = realloc(job_slabs, (job_slab_count + 1) * sizeof(Job *));
+  if (!slabs) {
+    perror("realloc");
+    return -1;
+  }
+  job_slabs = slabs;
+  Job *slab = calloc(JOB_SLAB_SIZE, sizeof(Job));
+  if (!slab) {
+    perror("calloc");
+    return -1;
+  }
+  job_slabs[job_slab_count++] = slab;
+  for (int i = JOB_SLAB_SIZE - 1; i >= 0; i--) {
+    slab[i].next = free_jobs;
+    free_jobs = &slab[i];
+  }
+  return 0;
+}
+
+static int grow_buckets(void) {
+  size_t new_count = bucket_count ? bucket_count * 2 : JOB_INITIAL_BUCKETS;
+  Job **ids = calloc(new_count, sizeof(Job *));
+  Job **pgids = calloc(new_count, sizeof(Job *));
+  if (!ids || !pgids) {
+    perror("calloc");
+    free(ids);
+    free(pgids);
+    return -1;
+  }
+  free(id_buckets);
+  free(pgid_buckets);
+  id_buckets = ids;
+  pgid_buckets = pgids;
+  bucket_count = new_count;
+
+  // Rehash in reverse id order so chains keep the newest job first
+  for (Job *job = job_tail; job; job = job->prev) {
+    size_t idx = hash_int(job->job_id);
+    job->id_chain = id_buckets[idx];
+    id_buckets[idx] = job;
+    idx = hash_int(job->pgid);
+    job->pgid_chain = pgid_buckets[idx];
+    pgid_buckets[idx] = job;
+  }
+  return 0;
+}
+
+static void unlink_chain(Job **bucket, Job *job, int by_pgid) {
+  Job **link = bucket;
+  while (*link && *link != job)
+    link = by_pgid ? &(*link)->pgid_chain : &(*link)->id_chain;
+  if (*link)
+    *link = by_pgid ? job->pgid_chain : job->id_chain;
+}
+
+static void queue_notification(Job *job) {
+  if (job->notify)
+    return;
+  job->notify = 1;
+  job->notify_next = NULL;
+  job->notify_prev = notify_tail;
+  if (notify_tail)
+    notify_tail->notify_next = job;
+  else
+    notify_head = job;
+  notify_tail = job;
+  pending_notifications++;
+}
+
+static void dequeue_notification(Job *job) {
+  if (!job->notify)
+    return;
+  job->notify = 0;
+  if (job->notify_prev)
+    job->notify_prev->notify_next = job->notify_next;
+  else
+    notify_head = job->notify_next;
+  if (job->notify_next)
+    job->notify_next->notify_prev = job->notify_prev;
+  else
+    notify_tail = job->notify_prev;
+  pending_notifications--;
+}
+
 void init_jobs() {
-  for (int i = 0; i < MAX_JOBS; ++i) {
-    job_table[i].pgid = 0;
-    job_table[i].command = NULL;
+  if (grow_buckets() != 0)
+    return;
+
+  // Self-pipe the SIGCHLD handler writes to, so child state changes can
+  // be waited for with poll() alongside stdin
+  if (pipe(g_sigchld_pipe) < 0) {
+    perror("pipe");
+    return;
+  }
+  for (int i = 0; i < 2; i++) {
+    fcntl(g_sigchld_pipe[i], F_SETFD, FD_CLOEXEC);
+    fcntl(g_sigchld_pipe[i], F_SETFL, O_NONBLOCK);
   }
 }
 
-int add_job(pid_t pgid, const char *command, int is_background) {
-  for (int i = 0; i < MAX_JOBS; ++i) {
-    if (job_table[i].pgid == 0) {
-      job_table[i].pgid = pgid;
-      job_table[i].job_id = next_job_id++;
-      job_table[i].status = JOB_RUNNING;
-      job_table[i].command = strdup(command);
-      job_table[i].is_background = is_background;
-      return job_table[i].job_id;
-    }
+int add_job(pid_t pgid, const char *command, int is_background,
+            const pid_t *pids, int pid_count) {
+  if (!free_jobs && grow_slabs() != 0)
+    return -1;
+  if (job_count >= bucket_count && grow_buckets() != 0)
+    return -1;
+  JobProcess *procs = calloc(pid_count > 0 ? pid_count : 1, sizeof(*procs));
+  if (!procs) {
+    perror("calloc");
+    return -1;
   }
-  fprintf(stderr, "shell: too many jobs\n");
-  return -1;
+
+  Job *job = free_jobs;
+  free_jobs = job->next;
+  memset(job, 0, sizeof(*job));
+  job->pgid = pgid;
+  job->job_id = next_job_id++;
+  job->command = strdup(command);
+  set_job_state(job, JOB_RUNNING, is_background);
+  clock_gettime(CLOCK_MONOTONIC, &job->start);
+  job->procs = procs;
+  job->proc_count = pid_count;
+  for (int i = 0; i < pid_count; i++)
+    procs[i].pid = pids[i];
+
+  // Ids only grow, so appending keeps the list in job id order
+  job->prev = job_tail;
+  if (job_tail)
+    job_tail->next = job;
+  else
+    job_head = job;
+  job_tail = job;
+
+  size_t idx = hash_int(job->job_id);
+  job->id_chain = id_buckets[idx];
+  id_buckets[idx] = job;
+  idx = hash_int(job->pgid);
+  job->pgid_chain = pgid_buckets[idx];
+  pgid_buckets[idx] = job;
+
+  job_count++;
+  return job->job_id;
 }
 
-void remove_job(pid_t pgid) {
-  for (int i = 0; i < MAX_JOBS; ++i) {
-    if (job_table[i].pgid == pgid) {
-      free(job_table[i].command);
-      job_table[i].pgid = 0;
-      job_table[i].command = NULL;
-      return;
+static void unlink_queued(Job *job) {
+  Job **link = &queue_head;
+  Job *prev = NULL;
+  while (*link && *link != job) {
+    prev = *link;
+    link = &(*link)->queue_next;
+  }
+  if (!*link)
+    return;
+  *link = job->queue_next;
+  if (queue_tail == job)
+    queue_tail = prev;
+  job->queue_next = NULL;
+}
+
+void delete_job(Job *job) {
+  dequeue_notification(job);
+  if (job->status == JOB_QUEUED)
+    unlink_queued(job);
+  set_job_state(job, JOB_DONE, 0); // Gives back its background slot
+  arena_free(&job->arena);
+  unlink_chain(&id_buckets[hash_int(job->job_id)], job, 0);
+  unlink_chain(&pgid_buckets[hash_int(job->pgid)], job, 1);
+
+  if (job->prev)
+    job->prev->next = job->next;
+  else
+    job_head = job->next;
+  if (job->next)
+    job->next->prev = job->prev;
+  else
+    job_tail = job->prev;
+
+  free(job->command);
+  free(job->procs);
+  job->command = NULL;
+  job->procs = NULL;
+  job->pgid = 0;
+  job->next = free_jobs;
+  free_jobs = job;
+  job_count--;
+}
+
+void set_job_pgid(Job *job, pid_t pgid) {
+  unlink_chain(&pgid_buckets[hash_int(job->pgid)], job, 1);
+  job->pgid = pgid;
+  size_t idx = hash_int(pgid);
+  job->pgid_chain = pgid_buckets[idx];
+  pgid_buckets[idx] = job;
+}
+
+int job_add_process(Job *job, pid_t pid) {
+  // Reuse the record of a process that is already reaped
+  for (int i = 0; i < job->proc_count; i++) {
+    if (job->procs[i].reaped) {
+      memset(&job->procs[i], 0, sizeof(job->procs[i]));
+      job->procs[i].pid = pid;
+      return 0;
     }
   }
+  JobProcess *grown =
+      realloc(job->procs, (job->proc_count + 1) * sizeof(*job->procs));
+  if (!grown) {
+    perror("realloc");
+    return -1;
+  }
+  job->procs = grown;
+  memset(&job->procs[job->proc_count], 0, sizeof(*job->procs));
+  job->procs[job->proc_count++].pid = pid;
+  return 0;
+}
+
+void remove_job(pid_t pgid) {
+  Job *job = get_job_by_pgid(pgid);
+  if (job)
+    delete_job(job);
 }
 
 Job *get_job_by_id(int job_id) {
-  for (int i = 0; i < MAX_JOBS; ++i) {
-    if (job_table[i].pgid != 0 && job_table[i].job_id == job_id) {
-      return &job_table[i];
-    }
+  if (bucket_count == 0)
+    return NULL;
+  for (Job *job = id_buckets[hash_int(job_id)]; job; job = job->id_chain) {
+    if (job->job_id == job_id)
+      return job;
   }
   return NULL;
 }
 
 Job *get_job_by_pgid(pid_t pgid) {
-  for (int i = 0; i < MAX_JOBS; ++i) {
-    if (job_table[i].pgid == pgid) {
-      return &job_table[i];
-    }
+  if (bucket_count == 0)
+    return NULL;
+  for (Job *job = pgid_buckets[hash_int(pgid)]; job; job = job->pgid_chain) {
+    if (job->pgid == pgid)
+      return job;
   }
   return NULL;
 }
 
+Job *first_job(void) { return job_head; }
+
+void set_job_state(Job *job, JobStatus status, int is_background) {
+  running_background -= job->is_background && job->status == JOB_RUNNING;
+  job->status = status;
+  job->is_background = is_background;
+  running_background += is_background && status == JOB_RUNNING;
+}
+
 void update_job_status(pid_t pgid, int status) {
   Job *job = get_job_by_pgid(pgid);
   if (!job)
     return;
   if (WIFSTOPPED(status)) {
-    job->status = JOB_STOPPED;
+    set_job_state(job, JOB_STOPPED, job->is_background);
   } else if (WIFSIGNALED(status) || WIFEXITED(status)) {
-    job->status = JOB_DONE;
+    set_job_state(job, JOB_DONE, job->is_background);
   }
 }
 
+int sample_process(const JobProcess *proc, ProcessSample *out) {
+  static long ticks_per_second = 0;
+  static long page_kib = 0;
+
+  memset(out, 0, sizeof(*out));
+  if (proc->reaped) {
+    out->state = 'X';
+    out->cpu_seconds = proc->usage.ru_utime.tv_sec +
+                       proc->usage.ru_utime.tv_usec / 1e6 +
+                       proc->usage.ru_stime.tv_sec +
+                       proc->usage.ru_stime.tv_usec / 1e6;
+    out->rss_kib = proc->usage.ru_maxrss;
+    return 0;
+  }
+
+  out->state = '?';
+  char path[32], buf[512];
+  snprintf(path, sizeof(path), "/proc/%d/stat", (int)proc->pid);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  ssize_t n = read(fd, buf, sizeof(buf) - 1);
+  close(fd);
+  if (n <= 0)
+    return -1;
+  buf[n] = '\0';
+
+  // "pid (comm) state ...": comm may hold spaces and parentheses, so
+  // the fields start after the last ')'
+  char *open_paren = strchr(buf, '(');
+  char *close_paren = strrchr(buf, ')');
+  if (!open_paren || !close_paren || close_paren < open_paren)
+    return -1;
+  size_t name_len = close_paren - open_paren - 1;
+  if (name_len >= sizeof(out->name))
+    name_len = sizeof(out->name) - 1;
+  memcpy(out->name, open_paren + 1, name_len);
+
+  unsigned long utime, stime;
+  long rss_pages;
+  if (sscanf(close_paren + 2,
+             "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %*d %*d "
+             "%*d %*d %*d %*d %*u %*u %ld",
+             &out->state, &utime, &stime, &rss_pages) != 4)
+    return -1;
+
+  if (!ticks_per_second) {
+    ticks_per_second = sysconf(_SC_CLK_TCK);
+    page_kib = sysconf(_SC_PAGESIZE) / 1024;
+  }
+  out->cpu_seconds = (double)(utime + stime) / ticks_per_second;
+  out->rss_kib = rss_pages * page_kib;
+  return 0;
+}
+
 void print_job_status(Job *job, int is_bg_completion) {
   if (is_bg_completion) {
     printf("[%d] Done %s\n", job->job_id, job->command);
+  } else if (job->status == JOB_QUEUED) {
+    printf("[%d] Queued %s\n", job->job_id, job->command);
   } else {
     printf("[%d] %d %s\n", job->job_id, job->pgid, job->command);
   }
 }
 
-void check_background_jobs() {
+// Usage of the processes reaped in the foreground while a `time` runs
+static struct rusage *timed_usage = NULL;
+
+// Collect one child state change. The status is peeked with WNOWAIT
+// first so the child's process group can still be read before the zombie
+// is released. Returns the pid, 0 if nothing is ready (WNOHANG), or -1.
+static pid_t reap_child(int options, int *status, pid_t *pgid,
+                        struct rusage *ru) {
+  siginfo_t info;
+  info.si_pid = 0;
+  if (waitid(P_ALL, 0, &info, WEXITED | WSTOPPED | WNOWAIT | options) < 0)
+    return -1;
+  if (info.si_pid == 0)
+    return 0;
+  *pgid = getpgid(info.si_pid);
+  return wait4(info.si_pid, status, WUNTRACED, ru);
+}
+
+static void add_timeval(struct timeval *acc, const struct timeval *tv) {
+  acc->tv_sec += tv->tv_sec;
+  acc->tv_usec += tv->tv_usec;
+  if (acc->tv_usec >= 1000000) {
+    acc->tv_sec++;
+    acc->tv_usec -= 1000000;
+  }
+}
+
+// Fold the usage of one reaped process into a job total. Times and
+// counters add up, the peak RSS is the largest of any process.
+static void add_rusage(struct rusage *acc, const struct rusage *ru) {
+  add_timeval(&acc->ru_utime, &ru->ru_utime);
+  add_timeval(&acc->ru_stime, &ru->ru_stime);
+  if (ru->ru_maxrss > acc->ru_maxrss)
+    acc->ru_maxrss = ru->ru_maxrss;
+  acc->ru_minflt += ru->ru_minflt;
+  acc->ru_majflt += ru->ru_majflt;
+  acc->ru_nvcsw += ru->ru_nvcsw;
+  acc->ru_nivcsw += ru->ru_nivcsw;
+}
+
+// Account an exited process to its job
+static void process_exited(Job *job, pid_t pid, int status,
+                           const struct rusage *ru) {
+  add_rusage(&job->usage, ru);
+  for (int i = 0; i < job->proc_count; i++) {
+    if (job->procs[i].pid == pid) {
+      job->procs[i].reaped = 1;
+      job->procs[i].status = status;
+      job->procs[i].usage = *ru;
+      break;
+    }
+  }
+}
+
+static int live_processes(const Job *job) {
+  int live = 0;
+  for (int i = 0; i < job->proc_count; i++)
+    live += !job->procs[i].reaped;
+  return live;
+}
+
+// A pipeline's status is that of its last stage
+static int last_stage_status(const Job *job) {
+  return job->proc_count > 0 ? job->procs[job->proc_count - 1].status : 0;
+}
+
+// Record a state change of a child outside the foreground wait. The user
+// is told about it later by notify_job_changes().
+static void record_child_status(pid_t pid, pid_t pgid, int status,
+                                const struct rusage *ru) {
+  Job *job = get_job_by_pgid(pgid);
+  if (!job || job->status == JOB_DONE)
+    return;
+  if (!WIFSTOPPED(status))
+    process_exited(job, pid, status, ru);
+  if (WIFSTOPPED(status)) {
+    if (job->status == JOB_STOPPED)
+      return;
+    set_job_state(job, JOB_STOPPED, job->is_background);
+  } else if (live_processes(job) == 0) {
+    // Every member has been reaped
+    set_job_state(job, JOB_DONE, job->is_background);
+    job->wait_status = last_stage_status(job);
+    if (job->is_background && queue_head)
+      start_queued_jobs(); // Its slot is free
+  } else {
+    return;
+  }
+  queue_notification(job);
+}
+
+static void reap_ready_children(void) {
   int status;
-  pid_t pid;
-  while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {
-    Job *job = get_job_by_pgid(pid);
+  pid_t pid, pgid;
+  struct rusage ru;
+  while ((pid = reap_child(WNOHANG, &status, &pgid, &ru)) > 0)
+    record_child_status(pid, pgid, status, &ru);
+}
+
+// Drain the self-pipe and reap everything that changed state since the
+// last SIGCHLD; a no-op when no SIGCHLD arrived.
+int handle_sigchld_events(void) {
+  char buf[64];
+
+  if (!g_sigchld_pending)
+    return pending_notifications;
+  g_sigchld_pending = 0;
+  while (read(g_sigchld_pipe[0], buf, sizeof(buf)) > 0)
+    ;
+
+  reap_ready_children();
+  return pending_notifications;
+}
+
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return syscall(SYS_pidfd_open, pid, 0);
+#else
+  (void)pid;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// Sleep until a process of job exits, or one of any running job when job
+// is NULL, and reap it. Each process gets a pidfd, which turns readable
+// when it exits, and all of them are waited on with one epoll set. Without
+// pidfds (kernels before 5.3) this waits for SIGCHLD on the self-pipe.
+// Returns 0, 1 if there is no process to wait for, or -1 on Ctrl-C.
+static int sleep_until_exit(Job *job) {
+  int live = 0;
+  for (Job *j = job ? job : job_head; j; j = job ? NULL : j->next) {
+    if (j->status != JOB_RUNNING)
+      continue;
+    for (int i = 0; i < j->proc_count; i++)
+      live += !j->procs[i].reaped;
+  }
+  if (live == 0)
+    return 1;
+
+  int *fds = malloc(live * sizeof(int));
+  int ep = fds ? epoll_create1(EPOLL_CLOEXEC) : -1;
+  int watched = 0;
+  int use_pidfd = ep >= 0;
+  for (Job *j = job ? job : job_head; j && use_pidfd;
+       j = job ? NULL : j->next) {
+    if (j->status != JOB_RUNNING)
+      continue;
+    for (int i = 0; i < j->proc_count && use_pidfd; i++) {
+      if (j->procs[i].reaped)
+        continue;
+      int fd = open_pidfd(j->procs[i].pid);
+      if (fd < 0) {
+        use_pidfd = errno == ESRCH; // Reaped behind the job table's back
+        continue;
+      }
+      struct epoll_event ev = {.events = EPOLLIN, .data.fd = fd};
+      fds[watched++] = fd;
+      if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0)
+        use_pidfd = 0;
+    }
+  }
+
+  int rc = 0;
+  if (use_pidfd && watched == 0) {
+    rc = 1;
+  } else if (use_pidfd) {
+    struct epoll_event ev;
+    while (epoll_wait(ep, &ev, 1, -1) < 0) {
+      if (errno != EINTR || g_sigint_received) {
+        rc = -1;
+        break;
+      }
+    }
+  } else {
+    // The pipe stays readable until drained, so a SIGCHLD that came in
+    // before the poll is not missed
+    struct pollfd pfd = {.fd = g_sigchld_pipe[0], .events = POLLIN};
+    siginfo_t info;
+    info.si_pid = 0;
+    if (waitid(P_ALL, 0, &info, WEXITED | WNOHANG | WNOWAIT) < 0)
+      rc = 1; // No children at all
+    while (rc == 0 && info.si_pid == 0 && poll(&pfd, 1, -1) < 0) {
+      if (errno != EINTR || g_sigint_received)
+        rc = -1;
+    }
+    if (rc == 0)
+      handle_sigchld_events();
+  }
+
+  for (int i = 0; i < watched; i++)
+    close(fds[i]);
+  if (ep >= 0)
+    close(ep);
+  free(fds);
+  if (rc == 0)
+    reap_ready_children();
+  return rc;
+}
+
+int wait_background(Job *job, Job **done) {
+  g_sigint_received = 0;
+  for (;;) {
     if (job) {
-      if (WIFSTOPPED(status)) {
-        job->status = JOB_STOPPED;
-        fprintf(stdout, "\nStopped: [%d] %s\n", job->job_id, job->command);
-      } else {
-        if (job->is_background) {
-          print_job_status(job, 1);
+      if (job->status == JOB_DONE) {
+        *done = job;
+        return 0;
+      }
+      if (job->status == JOB_STOPPED)
+        return 1;
+    } else {
+      int pending = 0;
+      for (Job *j = job_head; j; j = j->next) {
+        if (!j->is_background)
+          continue;
+        if (j->status == JOB_DONE) {
+          *done = j;
+          return 0;
         }
-        remove_job(pid);
+        pending += j->status == JOB_RUNNING || j->status == JOB_QUEUED;
       }
+      if (pending == 0)
+        return 1;
     }
+
+    // A queued job starts once some running one finishes
+    int rc = sleep_until_exit(job && job->status == JOB_RUNNING ? job : NULL);
+    if (rc != 0)
+      return rc;
   }
 }
 
-static char *reconstruct_command(CommandNode *cmd) {
-  char buffer[MAX_INPUT_SIZE] = {0};
-  for (int i = 0; cmd->args[i]; i++) {
-    strcat(buffer, cmd->args[i]);
-    strcat(buffer, " ");
+int notify_job_changes(void) {
+  int printed = 0;
+  if (pending_notifications == 0)
+    return 0;
+  while (notify_head) {
+    Job *job = notify_head;
+    dequeue_notification(job);
+    if (job->status == JOB_DONE) {
+      if (job->is_background) {
+        print_job_status(job, 1);
+        printed++;
+      }
+      delete_job(job);
+    } else if (job->status == JOB_STOPPED) {
+      fprintf(stdout, "\nStopped: [%d] %s\n", job->job_id, job->command);
+      printed++;
+    }
   }
-  return strdup(buffer);
+  fflush(stdout);
+  return printed;
 }
 
-static void apply_redirections(CommandNode *cmd) {
-  Redirection *r = cmd->redirections;
-  while (r) {
-    int fd;
-    if (r->type == REDIR_IN || r->type == REDIR_HEREDOC) {
-      fd = open(r->filename, O_RDONLY);
-      if (fd < 0) {
-        fprintf(stderr, "%s: No such file or directory\n", r->filename);
-        exit(EXIT_FAILURE);
-      }
-      dup2(fd, STDIN_FILENO);
-      close(fd);
-    } else if (r->type == REDIR_OUT) {
-      fd = open(r->filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-      dup2(fd, STDOUT_FILENO);
-      close(fd);
-    } else if (r->type == REDIR_APPEND) {
-      fd = open(r->filename, O_WRONLY | O_CREAT | O_APPEND, 0644);
-      dup2(fd, STDOUT_FILENO);
-      close(fd);
+void check_background_jobs() {
+  handle_sigchld_events();
+  notify_job_changes();
+}
+
+static char *append_words(char *p, char **words, int count) {
+  for (int i = 0; i < count; i++) {
+    size_t n = strlen(words[i]);
+    memcpy(p, words[i], n);
+    p += n;
+    *p++ = ' ';
+  }
+  return p;
+}
+
+// Join the stages' words back into "a b | c d" for the job table
+static char *reconstruct_command(CommandNode **stages, int count) {
+  size_t len = 1;
+  for (int s = 0; s < count; s++) {
+    for (int i = 0; i < stages[s]->assign_count; i++)
+      len += strlen(stages[s]->assigns[i]) + 1;
+    for (int i = 0; i < stages[s]->arg_count; i++)
+      len += strlen(stages[s]->args[i]) + 1;
+    len += 2; // "| "
+  }
+  char *buffer = malloc(len);
+  if (!buffer)
+    return NULL;
+  char *p = buffer;
+  for (int s = 0; s < count; s++) {
+    if (s > 0) {
+      memcpy(p, "| ", 2);
+      p += 2;
     }
-    r = r->next;
+    p = append_words(p, stages[s]->assigns, stages[s]->assign_count);
+    p = append_words(p, stages[s]->args, stages[s]->arg_count);
   }
+  if (p > buffer)
+    p--; // Drop the trailing separator
+  *p = '\0';
+  return buffer;
 }
 
-static void launch_process(CommandNode *cmd, pid_t pgid, int is_background,
-                           int in_fd, int out_fd, int is_pipe) {
-  if (!is_pipe && handle_builtin(cmd) != -1) {
-    exit(EXIT_SUCCESS);
+pid_t wait_job_process(Job *job, int *status) {
+  struct rusage ru;
+  for (;;) {
+    if (live_processes(job) == 0)
+      return -1;
+
+    pid_t member_pgid;
+    pid_t pid = reap_child(0, status, &member_pgid, &ru);
+    if (pid < 0)
+      return -1;
+    int member = 0;
+    for (int i = 0; i < job->proc_count && !member; i++)
+      member = job->procs[i].pid == pid && !job->procs[i].reaped;
+    if (!member) {
+      record_child_status(pid, member_pgid, *status, &ru);
+      continue;
+    }
+    if (!WIFSTOPPED(*status)) {
+      process_exited(job, pid, *status, &ru);
+      if (timed_usage)
+        add_rusage(timed_usage, &ru);
+    }
+    return pid;
   }
+}
+
+// Returns 1 while the shell still has unreaped children in group pgid
+static int group_has_children(pid_t pgid) {
+  siginfo_t info;
+  return waitid(P_PGID, pgid, &info,
+                WEXITED | WSTOPPED | WNOHANG | WNOWAIT) == 0;
+}
+
+// Map a wait status to the shell's $? convention
+static int exit_code(int status) {
+  if (WIFEXITED(status))
+    return WEXITSTATUS(status);
+  if (WIFSIGNALED(status))
+    return 128 + WTERMSIG(status);
+  if (WIFSTOPPED(status))
+    return 128 + WSTOPSIG(status);
+  return 0;
+}
 
-  pid_t pid = getpid();
-  if (pgid == 0)
-    pgid = pid;
-  setpgid(pid, pgid);
+int job_exit_status(const Job *job) { return exit_code(job->wait_status); }
 
-  if (!is_background) {
-    tcsetpgrp(STDIN_FILENO, pgid);
+static void set_pipestatus(const int *codes, int count) {
+  int *copy = malloc((count > 0 ? count : 1) * sizeof(int));
+  if (!copy) {
+    perror("malloc");
+    return;
+  }
+  memcpy(copy, codes, count * sizeof(int));
+  free(pipestatus);
+  pipestatus = copy;
+  pipestatus_count = count;
+  pipestatus_serial++;
+}
+
+int get_pipestatus(const int **codes) {
+  *codes = pipestatus;
+  return pipestatus_count;
+}
+
+// Take the statuses of a job's processes as the pipeline status. Members
+// still alive when the job stopped get the stop status.
+static void record_pipestatus(const Job *job, int stop_status) {
+  int *codes = malloc((job->proc_count > 0 ? job->proc_count : 1) *
+                      sizeof(int));
+  if (!codes) {
+    perror("malloc");
+    return;
   }
+  for (int i = 0; i < job->proc_count; i++)
+    codes[i] = exit_code(job->procs[i].reaped ? job->procs[i].status
+                                              : stop_status);
+  set_pipestatus(codes, job->proc_count);
+  free(codes);
+}
 
-  signal(SIGINT, SIG_DFL);
-  signal(SIGQUIT, SIG_DFL);
-  signal(SIGTSTP, SIG_DFL);
-  signal(SIGTTIN, SIG_DFL);
-  signal(SIGTTOU, SIG_DFL);
+void wait_for_job(Job *job) {
+  pid_t pgid = job->pgid;
+  int status = 0;
+  int stopped = 0;
+  struct rusage ru;
 
-  if (in_fd != STDIN_FILENO) {
-    dup2(in_fd, STDIN_FILENO);
-    close(in_fd);
+  // In batch mode the job shares the shell's group and already gets the
+  // terminal's signals; forwarding them would signal the shell itself
+  g_fg_pgid = pgid == getpgrp() ? 0 : pgid;
+  // Reap every member, not just the leader. Background children that
+  // change state meanwhile are reaped and recorded too. The group check
+  // keeps a member reaped elsewhere from blocking the wait forever.
+  while (live_processes(job) > 0 && group_has_children(pgid)) {
+    pid_t member_pgid;
+    pid_t pid = reap_child(0, &status, &member_pgid, &ru);
+    if (pid < 0)
+      break;
+    if (member_pgid != pgid) {
+      record_child_status(pid, member_pgid, status, &ru);
+    } else if (WIFSTOPPED(status)) {
+      stopped = 1;
+      break;
+    } else {
+      process_exited(job, pid, status, &ru);
+      if (timed_usage)
+        add_rusage(timed_usage, &ru);
+    }
   }
-  if (out_fd != STDOUT_FILENO) {
-    dup2(out_fd, STDOUT_FILENO);
-    close(out_fd);
+
+  record_pipestatus(job, status);
+  if (stopped) {
+    update_job_status(pgid, status);
+    print_job_status(job, 0);
+    g_last_status = exit_code(status);
+  } else {
+    job->wait_status = last_stage_status(job);
+    g_last_status = exit_code(job->wait_status);
+    remove_job(pgid);
   }
 
-  apply_redirections(cmd);
+  g_fg_pgid = 0;
+  if (g_interactive)
+    tcsetpgrp(STDIN_FILENO, getpgrp());
+}
 
-  // Built-ins can be part of a pipe, so check for them here before exec
-  if (handle_builtin(cmd) != -1) {
-    exit(EXIT_SUCCESS);
+// Returns 1 if cmd has a PATH=... prefix assignment. The shell's $PATH is
+// then the wrong one to look the command up on, both for the hash table
+// and for posix_spawnp; a forked child applies the assignment before
+// execvpe searches.
+static int sets_own_path(const CommandNode *cmd) {
+  for (int i = 0; i < cmd->assign_count; i++) {
+    if (strncmp(cmd->assigns[i], "PATH=", 5) == 0)
+      return 1;
   }
+  return 0;
+}
 
-  if (execvp(cmd->args[0], cmd->args) < 0) {
-    perror(cmd->args[0]);
-    exit(EXIT_FAILURE);
+static int background_slots_full(void) {
+  return g_bg_limit > 0 && running_background >= g_bg_limit;
+}
+
+static char **clone_words(Arena *arena, char **words, int count) {
+  char **copy = arena_calloc(arena, count + 1, sizeof(char *));
+  for (int i = 0; copy && i < count; i++) {
+    if (!(copy[i] = arena_strndup(arena, words[i], strlen(words[i]))))
+      return NULL;
   }
+  return copy;
 }
 
-static void execute_command(CommandNode *cmd, pid_t pgid, int is_background) {
-  if (!is_background && cmd->arg_count > 0 && handle_builtin(cmd) != -1) {
-    return; // Handle built-in in parent shell for non-background cases
+static CommandNode *clone_command(Arena *arena, const CommandNode *cmd) {
+  CommandNode *copy = arena_alloc(arena, sizeof(*copy));
+  if (!copy)
+    return NULL;
+  *copy = *cmd;
+  copy->args = clone_words(arena, cmd->args, cmd->arg_count);
+  copy->assigns = clone_words(arena, cmd->assigns, cmd->assign_count);
+  if (!copy->args || !copy->assigns)
+    return NULL;
+
+  Redirection **link = &copy->redirections;
+  for (const Redirection *r = cmd->redirections; r; r = r->next) {
+    Redirection *rc = arena_alloc(arena, sizeof(*rc));
+    if (!rc)
+      return NULL;
+    *rc = *r;
+    rc->filename = arena_strndup(arena, r->filename, strlen(r->filename));
+    if (!rc->filename)
+      return NULL;
+    if (r->body && !(rc->body = arena_strndup(arena, r->body, r->body_len)))
+      return NULL;
+    rc->next = NULL;
+    *link = rc;
+    link = &rc->next;
   }
+  return copy;
+}
 
-  char *full_command = reconstruct_command(cmd);
+// Park a background pipeline as a queued job. The stages are copied into
+// the job's arena, since the tree may be a cached one that gets reused.
+static void queue_pipeline(CommandNode **stages, int count) {
+  char *command = reconstruct_command(stages, count);
+  if (!command)
+    return;
+  int job_id = add_job(0, command, 1, NULL, 0);
+  free(command);
+  Job *job = get_job_by_id(job_id);
+  if (!job)
+    return;
+  set_job_state(job, JOB_QUEUED, 1);
+  arena_init(&job->arena);
+  job->stages = arena_calloc(&job->arena, count, sizeof(CommandNode *));
+  for (int i = 0; job->stages && i < count; i++) {
+    if (!(job->stages[i] = clone_command(&job->arena, stages[i]))) {
+      job->stages = NULL;
+      break;
+    }
+  }
+  if (!job->stages) {
+    fprintf(stderr, "Failed to queue job: %s\n", job->command);
+    delete_job(job);
+    return;
+  }
+  job->stage_count = count;
+  if (queue_tail)
+    queue_tail->queue_next = job;
+  else
+    queue_head = job;
+  queue_tail = job;
+  print_job_status(job, 0);
+}
 
-  pid_t pid = fork();
-  if (pid == 0) { // Child
-    launch_process(cmd, pgid, is_background, STDIN_FILENO, STDOUT_FILENO, 0);
-  } else if (pid > 0) { // Parent
-    if (pgid == 0)
-      pgid = pid;
-    setpgid(pid, pgid);
+// Start every stage as a direct child of the shell in one process group,
+// with all pipes created up front, and track the whole thing as one job.
+// In the foreground the last built-in stage runs inside the shell once the
+// external stages are up; any earlier built-in still gets a forked child,
+// since running two in turn could block the first on a full pipe. Built-ins
+// that change shell state (hop, exit, fg, bg) always get a child inside a
+// pipeline, as in other shells. So do cat and parallel: they can wait on a
+// pipe indefinitely, and only a process of their own is stopped by Ctrl-Z
+// with the rest of the job. parallel gets one even on its own. A queued
+// job passed in gets the new processes instead of a new job being made.
+static void execute_pipeline(CommandNode **stages, int count,
+                             int is_background, Job *queued) {
+  if (is_background && !queued && background_slots_full()) {
+    queue_pipeline(stages, count);
+    return;
+  }
 
-    add_job(pgid, full_command, is_background);
+  int inline_stage = -1;
+  if (!is_background) {
+    for (int i = count - 1; i >= 0; i--) {
+      const char *name = stages[i]->arg_count > 0 ? stages[i]->args[0] : NULL;
+      // Only the first stage reads the shell's stdin, the rest a pipe
+      if (runs_as_builtin(stages[i], i == 0 ? STDIN_FILENO : -1)) {
+        if (!needs_own_process(name) &&
+            (count == 1 ||
+             (!is_parent_builtin(name) && !is_streaming_builtin(name))))
+          inline_stage = i;
+        break;
+      }
+    }
+  }
 
-    if (!is_background) {
-      g_fg_pgid = pgid;
-      int status;
-      waitpid(pid, &status, WUNTRACED);
+  int (*pipes)[2] = NULL;
+  // Without job control foreground commands stay in the shell's group, so
+  // they can read from a terminal the shell does not own
+  pid_t pgid = (!g_interactive && !is_background) ? getpgrp() : 0;
+  int started = 0;
 
-      if (WIFSTOPPED(status)) {
-        update_job_status(pgid, status);
-        Job *job = get_job_by_pgid(pgid);
-        if (job)
-          print_job_status(job, 0);
-      } else {
-        remove_job(pgid);
+  pid_t *pids = malloc(count * sizeof(*pids));
+  // Statuses of the stages without a process of their own, -1 for the rest
+  int *stage_codes = malloc(count * sizeof(int));
+  if (!pids || !stage_codes) {
+    perror("malloc");
+    free(pids);
+    free(stage_codes);
+    return;
+  }
+  for (int i = 0; i < count; i++)
+    stage_codes[i] = -1;
+  if (count > 1) {
+    pipes = malloc((count - 1) * sizeof(*pipes));
+    if (!pipes) {
+      perror("malloc");
+      free(pids);
+      free(stage_codes);
+      return;
+    }
+    for (int i = 0; i < count - 1; i++) {
+      if (pipe(pipes[i]) < 0) {
+        perror("pipe");
+        for (int j = 0; j < i; j++) {
+          close(pipes[j][0]);
+          close(pipes[j][1]);
+        }
+        free(pipes);
+        free(pids);
+        free(stage_codes);
+        return;
       }
+      // Stages only keep the ends that get dup'ed onto stdin/stdout
+      fcntl(pipes[i][0], F_SETFD, FD_CLOEXEC);
+      fcntl(pipes[i][1], F_SETFD, FD_CLOEXEC);
+    }
+  }
+
+  char *full_command = reconstruct_command(stages, count);
 
-      g_fg_pgid = 0;
-      tcsetpgrp(STDIN_FILENO, getpgrp());
+  for (int i = 0; i < count; i++) {
+    CommandNode *cmd = stages[i];
+    int in_fd = i > 0 ? pipes[i - 1][0] : STDIN_FILENO;
+    int out_fd = i < count - 1 ? pipes[i][1] : STDOUT_FILENO;
+    if (i == inline_stage)
+      continue; // Its pipe ends stay open until it has run
+
+    // Resolve before forking so the lookup is cached in the parent's table
+    int is_external = cmd->arg_count > 0 && !runs_as_builtin(cmd, in_fd);
+    int own_path = is_external && sets_own_path(cmd);
+    const char *path =
+        is_external && !own_path ? path_cache_lookup(cmd->args[0]) : NULL;
+
+    // Our buffered output goes first; a forked child would also flush it
+    // again. Matters in batch mode where stdout is fully buffered.
+    fflush(stdout);
+
+    // Built-ins that end up here have to run in a forked child
+    pid_t pid;
+    if (g_launch_mode == LAUNCH_SPAWN && is_external && !own_path) {
+      pid = spawn_process(cmd, path, pgid, is_background, in_fd, out_fd);
     } else {
-      Job *job = get_job_by_pgid(pgid);
-      if (job)
-        print_job_status(job, 0);
+      pid = fork();
+      if (pid == 0) { // Child
+        for (int j = 0; j < count - 1; j++) {
+          if (pipes[j][0] != in_fd)
+            close(pipes[j][0]);
+          if (pipes[j][1] != out_fd)
+            close(pipes[j][1]);
+        }
+        launch_process(cmd, path, pgid, is_background, in_fd, out_fd,
+                       count > 1);
+      } else if (pid < 0) {
+        perror("fork");
+      }
+    }
+
+    if (pid > 0) {
+      if (pgid == 0)
+        pgid = pid;
+      setpgid(pid, pgid);
+      pids[started++] = pid;
+    } else {
+      stage_codes[i] = 127;
+    }
+
+    // Each pipe end belongs to exactly one stage
+    if (in_fd != STDIN_FILENO)
+      close(in_fd);
+    if (out_fd != STDOUT_FILENO)
+      close(out_fd);
+  }
+
+  // Register the job before a built-in stage runs, so members that exit
+  // meanwhile are accounted to it
+  Job *job = NULL;
+  if (queued) {
+    if (started > 0) {
+      set_job_pgid(queued, pgid);
+      for (int i = 0; i < started; i++)
+        job_add_process(queued, pids[i]);
+      set_job_state(queued, JOB_RUNNING, 1);
+      clock_gettime(CLOCK_MONOTONIC, &queued->start);
+    } else {
+      // Report it like any other finished job
+      set_job_state(queued, JOB_DONE, 1);
+      queued->wait_status = 127 << 8;
+      queue_notification(queued);
+    }
+  } else if (started > 0 && full_command) {
+    add_job(pgid, full_command, is_background, pids, started);
+    job = get_job_by_pgid(pgid);
+  }
+
+  int inline_status = 0;
+  if (inline_stage >= 0) {
+    int in_fd = inline_stage > 0 ? pipes[inline_stage - 1][0] : STDIN_FILENO;
+    int out_fd =
+        inline_stage < count - 1 ? pipes[inline_stage][1] : STDOUT_FILENO;
+    inline_status = run_builtin_in_shell(stages[inline_stage], in_fd, out_fd);
+    stage_codes[inline_stage] = inline_status;
+    // Closing the write end is what lets the next stage see EOF
+    if (in_fd != STDIN_FILENO)
+      close(in_fd);
+    if (out_fd != STDOUT_FILENO)
+      close(out_fd);
+  }
+  free(pipes);
+
+  if (started == 0)
+    g_last_status = inline_stage >= 0 ? inline_status : 127;
+  else if (is_background)
+    g_last_status = 0;
+
+  if (is_background) {
+    if (job)
+      print_job_status(job, 0);
+    if (!queued) {
+      int zero = 0;
+      set_pipestatus(&zero, 1);
     }
   } else {
-    perror("fork");
+    pipestatus_count = 0;
+    if (job)
+      wait_for_job(job);
+    // Fill in the stages that had no process, in pipeline order
+    int from_job = 0;
+    for (int i = 0; i < count; i++) {
+      if (stage_codes[i] < 0 && from_job < pipestatus_count)
+        stage_codes[i] = pipestatus[from_job++];
+      else if (stage_codes[i] < 0)
+        stage_codes[i] = 0;
+    }
+    set_pipestatus(stage_codes, count);
+    if (started > 0 && inline_stage == count - 1)
+      g_last_status = inline_status; // The last stage decides
   }
+  free(stage_codes);
+  free(pids);
   free(full_command);
 }
 
-static void execute_pipe(PipeNode *node, int is_background) {
-  int pipefd[2];
-  pid_t left_pid, right_pid;
-  int status;
-
-  if (pipe(pipefd) < 0) {
-    perror("pipe");
+static void execute_command(CommandNode *cmd, int is_background) {
+  if (cmd->arg_count == 0) {
+    // NAME=value on its own sets a shell variable. A background one
+    // would only change a subshell, as elsewhere.
+    int status = 0;
+    for (int i = 0; !is_background && i < cmd->assign_count; i++)
+      status |= vars_assign(cmd->assigns[i], 0) != 0;
+    if (!cmd->redirections) {
+      g_last_status = status;
+      set_pipestatus(&g_last_status, 1);
+      return;
+    }
+  }
+  if (!is_background && runs_as_builtin(cmd, STDIN_FILENO) &&
+      !needs_own_process(cmd->args[0])) {
+    // Handle built-in in parent shell for non-background cases
+    unsigned long serial = pipestatus_serial;
+    g_last_status = run_builtin_in_shell(cmd, STDIN_FILENO, STDOUT_FILENO);
+    // fg leaves the status of the job it waited for
+    if (pipestatus_serial == serial)
+      set_pipestatus(&g_last_status, 1);
     return;
   }
+  execute_pipeline(&cmd, 1, is_background, NULL);
+}
 
-  left_pid = fork();
-  if (left_pid == 0) { // First child (left side of pipe)
-    close(pipefd[0]);
-    // Recursively execute the left side, writing to the pipe
-    execute_ast(node->left);
-    exit(EXIT_FAILURE); // Should not be reached
-  }
+void start_queued_job(Job *job) {
+  unlink_queued(job);
+  // Runs in between other commands; their status is what $? shows
+  int saved_status = g_last_status;
+  execute_pipeline(job->stages, job->stage_count, 1, job);
+  g_last_status = saved_status;
+  job->stages = NULL;
+  job->stage_count = 0;
+  arena_free(&job->arena);
+}
+
+void start_queued_jobs(void) {
+  while (queue_head && !background_slots_full())
+    start_queued_job(queue_head);
+}
+
+void drain_job_queue(void) {
+  int status;
+  pid_t pid, pgid;
+  struct rusage ru;
+  start_queued_jobs();
+  while (queue_head && (pid = reap_child(0, &status, &pgid, &ru)) > 0)
+    record_child_status(pid, pgid, status, &ru);
+  notify_job_changes();
+}
+
+static int count_stages(ASTNode *node) {
+  if (node->type != NODE_PIPE)
+    return 1;
+  PipeNode *p = (PipeNode *)node;
+  return count_stages(p->left) + count_stages(p->right);
+}
 
-  right_pid = fork();
-  if (right_pid == 0) { // Second child (right side of pipe)
-    close(pipefd[1]);
-    dup2(pipefd[0], STDIN_FILENO); // Read from the pipe
-    close(pipefd[0]);
-    // Recursively execute the right side
-    execute_ast(node->right);
-    exit(EXIT_FAILURE); // Should not be reached
+static CommandNode **flatten_stages(ASTNode *node, CommandNode **out) {
+  if (node->type != NODE_PIPE) {
+    *out++ = (CommandNode *)node;
+    return out;
   }
+  PipeNode *p = (PipeNode *)node;
+  out = flatten_stages(p->left, out);
+  return flatten_stages(p->right, out);
+}
+
+static double timespec_seconds(const struct timespec *ts) {
+  return ts->tv_sec + ts->tv_nsec / 1e9;
+}
+
+static double timeval_seconds(const struct timeval *tv) {
+  return tv->tv_sec + tv->tv_usec / 1e6;
+}
+
+static void print_time(const char *label, double seconds) {
+  long minutes = (long)(seconds / 60);
+  fprintf(stderr, "%s\t%ldm%.3fs\n", label, minutes, seconds - minutes * 60);
+}
+
+// Run a pipeline and report its cost. External processes are accounted
+// through wait4(); builtins run inside the shell, so the shell's own
+// usage over the same interval is added.
+static void execute_timed(TimeNode *node) {
+  struct timespec start, end;
+  struct rusage self_before, self_after;
+  struct rusage children;
+  struct rusage *outer = timed_usage;
+
+  memset(&children, 0, sizeof(children));
+  getrusage(RUSAGE_SELF, &self_before);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  timed_usage = &children;
+  execute_ast(node->body);
+  timed_usage = outer;
 
-  // Parent
-  close(pipefd[0]);
-  close(pipefd[1]);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  getrusage(RUSAGE_SELF, &self_after);
+  if (outer)
+    add_rusage(outer, &children); // `time time cmd`
 
-  // Wait for both children to finish
-  waitpid(left_pid, &status, 0);
-  waitpid(right_pid, &status, 0);
+  double user = timeval_seconds(&children.ru_utime) +
+                timeval_seconds(&self_after.ru_utime) -
+                timeval_seconds(&self_before.ru_utime);
+  double sys = timeval_seconds(&children.ru_stime) +
+               timeval_seconds(&self_after.ru_stime) -
+               timeval_seconds(&self_before.ru_stime);
+  // With no child reaped the only process involved was the shell
+  long maxrss = children.ru_maxrss ? children.ru_maxrss : self_after.ru_maxrss;
+  long nvcsw = children.ru_nvcsw + self_after.ru_nvcsw - self_before.ru_nvcsw;
+  long nivcsw =
+      children.ru_nivcsw + self_after.ru_nivcsw - self_before.ru_nivcsw;
+
+  fprintf(stderr, "\n");
+  print_time("real", timespec_seconds(&end) - timespec_seconds(&start));
+  print_time("user", user);
+  print_time("sys", sys);
+  fprintf(stderr, "maxrss\t%ld KiB\n", maxrss);
+  fprintf(stderr, "ctxsw\t%ld voluntary, %ld involuntary\n", nvcsw, nivcsw);
 }
 
 void execute_ast(ASTNode *node) {
@@ -258,21 +1210,39 @@ void execute_ast(ASTNode *node) {
     return;
   switch (node->type) {
   case NODE_COMMAND: {
+    // Variables are expanded right before running, into a scratch arena;
+    // the tree itself may be cached
     CommandNode *cmd = (CommandNode *)node;
-    execute_command(cmd, 0, cmd->background);
+    Arena arena;
+    arena_init(&arena);
+    CommandNode *expanded = vars_expand_command(&arena, cmd);
+    if (expanded)
+      execute_command(expanded, cmd->background);
+    else
+      g_last_status = 1;
+    arena_free(&arena);
     break;
   }
   case NODE_PIPE: {
-    // Check if the entire pipe is background
-    ASTNode *temp = node;
-    int is_bg = 0;
-    while (temp->type == NODE_PIPE) {
-      temp = ((PipeNode *)temp)->right;
-    }
-    if (temp->type == NODE_COMMAND) {
-      is_bg = ((CommandNode *)temp)->background;
+    int count = count_stages(node);
+    CommandNode **stages = malloc(count * sizeof(CommandNode *));
+    if (!stages) {
+      perror("malloc");
+      break;
     }
-    execute_pipe((PipeNode *)node, is_bg);
+    flatten_stages(node, stages);
+    Arena arena;
+    arena_init(&arena);
+    int expanded = 1;
+    for (int i = 0; expanded && i < count; i++)
+      expanded = (stages[i] = vars_expand_command(&arena, stages[i])) != NULL;
+    // The pipeline runs in the background if its last stage ends with '&'
+    if (expanded)
+      execute_pipeline(stages, count, stages[count - 1]->background, NULL);
+    else
+      g_last_status = 1;
+    arena_free(&arena);
+    free(stages);
     break;
   }
   case NODE_SEQUENCE:
@@ -280,5 +1250,8 @@ void execute_ast(ASTNode *node) {
     check_background_jobs(); // Reap jobs between sequential commands
     execute_ast(((SequenceNode *)node)->right);
     break;
+  case NODE_TIME:
+    execute_timed((TimeNode *)node);
+    break;
   }
 }
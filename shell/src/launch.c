@@ -0,0 +1,314 @@
+#define _GNU_SOURCE // posix_spawn_file_actions_addtcsetpgrp_np, memfd_create
+#include "../include/launch.h"
+#include "../include/intrinsics.h"
+#include "../include/vars.h"
+#include <spawn.h>
+#include <sys/mman.h>
+
+// glibc 2.35+ can hand the terminal to the child's group inside the spawn
+#if defined(__GLIBC__) &&                                                      \
+    (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define HAVE_SPAWN_TCSETPGRP 1
+#endif
+
+LaunchMode g_launch_mode = LAUNCH_SPAWN;
+
+// Write all of buf to fd
+static int write_all(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = write(fd, buf, len);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+// A readable descriptor holding a here-document body. Bodies that fit in
+// a pipe without blocking go through one; larger ones are put in an
+// anonymous memory file. Nothing touches the filesystem either way.
+static int open_heredoc(const Redirection *r) {
+  int fd;
+  if (r->body_len <= PIPE_BUF) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0)
+      return -1;
+    if (write_all(fds[1], r->body, r->body_len) < 0) {
+      int saved_errno = errno;
+      close(fds[0]);
+      close(fds[1]);
+      errno = saved_errno;
+      return -1;
+    }
+    close(fds[1]);
+    return fds[0];
+  }
+
+  fd = memfd_create("heredoc", MFD_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  if (write_all(fd, r->body, r->body_len) < 0 ||
+      lseek(fd, 0, SEEK_SET) < 0) {
+    int saved_errno = errno;
+    close(fd);
+    errno = saved_errno;
+    return -1;
+  }
+  return fd;
+}
+
+int open_redirection(const Redirection *r) {
+  int fd = -1;
+  switch (r->type) {
+  case REDIR_IN:
+    fd = open(r->filename, O_RDONLY | O_CLOEXEC);
+    break;
+  case REDIR_HEREDOC:
+    fd = open_heredoc(r);
+    break;
+  case REDIR_OUT:
+    fd = open(r->filename, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    break;
+  case REDIR_APPEND:
+    fd = open(r->filename, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    break;
+  case REDIR_NONE:
+    break;
+  }
+  if (fd < 0)
+    fprintf(stderr, "%s: %s\n", r->filename, strerror(errno));
+  return fd;
+}
+
+static int redirection_target(const Redirection *r) {
+  return (r->type == REDIR_IN || r->type == REDIR_HEREDOC) ? STDIN_FILENO
+                                                           : STDOUT_FILENO;
+}
+
+static void apply_redirections(CommandNode *cmd) {
+  for (Redirection *r = cmd->redirections; r; r = r->next) {
+    int fd = open_redirection(r);
+    if (fd < 0)
+      exit(EXIT_FAILURE);
+    dup2(fd, redirection_target(r));
+    close(fd);
+  }
+}
+
+int run_builtin_in_shell(CommandNode *cmd, int in_fd, int out_fd) {
+  if (cmd->assign_count > 0) {
+    // Prefix assignments hold for this one built-in
+    VarSave *save = vars_apply(cmd->assigns, cmd->assign_count);
+    CommandNode plain = *cmd;
+    plain.assign_count = 0;
+    int ret = run_builtin_in_shell(&plain, in_fd, out_fd);
+    vars_restore(save);
+    return ret;
+  }
+
+  // Nothing to swap: the common case of a plain builtin at the prompt
+  if (in_fd == STDIN_FILENO && out_fd == STDOUT_FILENO && !cmd->redirections)
+    return handle_builtin(cmd);
+
+  fflush(stdout);
+  int saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+  int saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+  int was_tty = isatty(STDOUT_FILENO);
+  int ret = 1;
+
+  if (in_fd != STDIN_FILENO)
+    dup2(in_fd, STDIN_FILENO);
+  if (out_fd != STDOUT_FILENO)
+    dup2(out_fd, STDOUT_FILENO);
+  int redirected = 1;
+  for (Redirection *r = cmd->redirections; r; r = r->next) {
+    int fd = open_redirection(r);
+    if (fd < 0) {
+      redirected = 0;
+      break;
+    }
+    dup2(fd, redirection_target(r));
+    close(fd);
+  }
+
+  if (redirected) {
+    // Output headed for a pipe or file is written in large blocks instead
+    // of a line at a time. A reader that quits early must not kill the
+    // shell, so EPIPE is reported instead of SIGPIPE.
+    struct sigaction ignore, saved_pipe;
+    memset(&ignore, 0, sizeof(ignore));
+    ignore.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, &ignore, &saved_pipe);
+    if (was_tty && !isatty(STDOUT_FILENO))
+      setvbuf(stdout, NULL, _IOFBF, BUFSIZ);
+
+    ret = handle_builtin(cmd);
+
+    fflush(stdout);
+    clearerr(stdout);
+    if (was_tty && !isatty(STDOUT_FILENO))
+      setvbuf(stdout, NULL, _IOLBF, BUFSIZ);
+    sigaction(SIGPIPE, &saved_pipe, NULL);
+  }
+
+  dup2(saved_in, STDIN_FILENO);
+  dup2(saved_out, STDOUT_FILENO);
+  close(saved_in);
+  close(saved_out);
+  return ret;
+}
+
+void launch_process(CommandNode *cmd, const char *path, pid_t pgid,
+                    int is_background, int in_fd, int out_fd, int is_pipe) {
+  int ret;
+  // This process is thrown away, so prefix assignments are simply made
+  for (int i = 0; i < cmd->assign_count; i++)
+    vars_assign(cmd->assigns[i], 1);
+  if (!is_pipe && runs_as_builtin(cmd, in_fd) &&
+      !needs_own_process(cmd->args[0]) && (ret = handle_builtin(cmd)) != -1) {
+    exit(ret);
+  }
+
+  pid_t pid = getpid();
+  if (pgid == 0)
+    pgid = pid;
+  setpgid(pid, pgid);
+
+  if (!is_background && g_interactive) {
+    tcsetpgrp(STDIN_FILENO, pgid);
+  }
+
+  signal(SIGINT, SIG_DFL);
+  signal(SIGQUIT, SIG_DFL);
+  signal(SIGTSTP, SIG_DFL);
+  signal(SIGTTIN, SIG_DFL);
+  signal(SIGTTOU, SIG_DFL);
+
+  if (in_fd != STDIN_FILENO) {
+    dup2(in_fd, STDIN_FILENO);
+    close(in_fd);
+  }
+  if (out_fd != STDOUT_FILENO) {
+    dup2(out_fd, STDOUT_FILENO);
+    close(out_fd);
+  }
+
+  apply_redirections(cmd);
+  if (cmd->arg_count == 0)
+    exit(EXIT_SUCCESS); // Nothing to run, the files are opened
+
+  // Built-ins can be part of a pipe, so check for them here before exec
+  if (runs_as_builtin(cmd, STDIN_FILENO) &&
+      (ret = handle_builtin(cmd)) != -1) {
+    exit(ret);
+  }
+
+  // The parent resolved the command through the hash table; only fall back
+  // to a $PATH walk when it could not.
+  if (path)
+    execve(path, cmd->args, vars_environ());
+  else
+    execvpe(cmd->args[0], cmd->args, vars_environ());
+  perror(cmd->args[0]);
+  exit(errno == ENOENT ? 127 : 126);
+}
+
+pid_t spawn_process(CommandNode *cmd, const char *path, pid_t pgid,
+                    int is_background, int in_fd, int out_fd) {
+  posix_spawnattr_t attr;
+  posix_spawn_file_actions_t actions;
+  sigset_t sigdefault, sigmask;
+  int redir_total = 0;
+  for (Redirection *r = cmd->redirections; r; r = r->next)
+    redir_total++;
+  int redir_fds[redir_total + 1];
+  int redir_count = 0;
+  pid_t pid = -1;
+
+  posix_spawnattr_init(&attr);
+  posix_spawn_file_actions_init(&actions);
+
+  // Same setup launch_process does by hand after fork()
+  posix_spawnattr_setpgroup(&attr, pgid);
+  sigemptyset(&sigdefault);
+  sigaddset(&sigdefault, SIGINT);
+  sigaddset(&sigdefault, SIGQUIT);
+  sigaddset(&sigdefault, SIGTSTP);
+  sigaddset(&sigdefault, SIGTTIN);
+  sigaddset(&sigdefault, SIGTTOU);
+  posix_spawnattr_setsigdefault(&attr, &sigdefault);
+  sigemptyset(&sigmask);
+  posix_spawnattr_setsigmask(&attr, &sigmask);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP |
+                                      POSIX_SPAWN_SETSIGDEF |
+                                      POSIX_SPAWN_SETSIGMASK);
+
+  int take_terminal = !is_background && g_interactive;
+#ifdef HAVE_SPAWN_TCSETPGRP
+  if (take_terminal) {
+    // Must run before fd 0 is replaced by a pipe or redirection
+    posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+  }
+#endif
+
+  if (in_fd != STDIN_FILENO) {
+    posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+    posix_spawn_file_actions_addclose(&actions, in_fd);
+  }
+  if (out_fd != STDOUT_FILENO) {
+    posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, out_fd);
+  }
+
+  // Open redirections in the parent so failures are reported before the
+  // child exists; the descriptors are close-on-exec, dup2 clears that.
+  for (Redirection *r = cmd->redirections; r; r = r->next) {
+    int fd = open_redirection(r);
+    if (fd < 0)
+      goto out;
+    redir_fds[redir_count++] = fd;
+    posix_spawn_file_actions_adddup2(&actions, fd, redirection_target(r));
+  }
+
+  // The shared envp is used as is; only prefix assignments need a copy
+  char **envp = cmd->assign_count > 0
+                    ? vars_environ_with(cmd->assigns, cmd->assign_count)
+                    : vars_environ();
+  if (!envp)
+    goto out;
+  int err;
+  if (path)
+    err = posix_spawn(&pid, path, &actions, &attr, cmd->args, envp);
+  else
+    err = posix_spawnp(&pid, cmd->args[0], &actions, &attr, cmd->args,
+                       envp);
+  if (cmd->assign_count > 0)
+    free(envp);
+  if (err != 0) {
+    fprintf(stderr, "%s: %s\n", cmd->args[0], strerror(err));
+    // The child took the terminal for a group that is gone now and that
+    // nobody will wait for
+    if (take_terminal && pgid == 0)
+      tcsetpgrp(STDIN_FILENO, getpgrp());
+    pid = -1;
+    goto out;
+  }
+
+#ifndef HAVE_SPAWN_TCSETPGRP
+  if (take_terminal)
+    tcsetpgrp(STDIN_FILENO, pgid ? pgid : pid);
+#else
+  (void)take_terminal;
+#endif
+
+out:
+  for (int i = 0; i < redir_count; i++)
+    close(redir_fds[i]);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  return pid;
+}
@@ -0,0 +1,490 @@
+#define _GNU_SOURCE // memrchr
+#include "../include/lineedit.h"
+#include "../include/complete.h"
+#include "../include/history.h"
+#include "../include/jobs.h"
+#include <ctype.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+
+#define LIST_CONFIRM_COUNT 100 // Ask before listing more matches than this
+
+// Keys that arrive as escape sequences
+enum {
+  KEY_NONE = 256, // Unknown sequence, ignored
+  KEY_UP,
+  KEY_DOWN,
+  KEY_LEFT,
+  KEY_RIGHT,
+  KEY_HOME,
+  KEY_END,
+  KEY_DELETE
+};
+
+#define CTRL_KEY(c) ((c) & 0x1f)
+
+typedef struct {
+  const char *prompt;
+  size_t prompt_len;
+  char *buf; // The line, always NUL-terminated
+  size_t len, pos, cap;
+  size_t history_index; // Entries back from the newest; 0 is the new line
+  char *saved;          // The new line while browsing the history
+} Editor;
+
+// Output is assembled here and written in one piece to avoid flicker
+typedef struct {
+  char *data;
+  size_t len, cap;
+} OutBuf;
+
+static void out_append(OutBuf *o, const char *s, size_t n) {
+  if (o->len + n > o->cap) {
+    size_t cap = o->cap ? o->cap * 2 : 256;
+    while (cap < o->len + n)
+      cap *= 2;
+    char *grown = realloc(o->data, cap);
+    if (!grown)
+      return;
+    o->data = grown;
+    o->cap = cap;
+  }
+  memcpy(o->data + o->len, s, n);
+  o->len += n;
+}
+
+static void out_flush(OutBuf *o) {
+  for (size_t off = 0; off < o->len;) {
+    ssize_t w = write(STDOUT_FILENO, o->data + off, o->len - off);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w < 0)
+      break;
+    off += w;
+  }
+  free(o->data);
+  memset(o, 0, sizeof(*o));
+}
+
+static void write_str(const char *s) {
+  OutBuf o = {0};
+  out_append(&o, s, strlen(s));
+  out_flush(&o);
+}
+
+static size_t terminal_width(void) {
+  struct winsize ws;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+    return ws.ws_col;
+  return 80;
+}
+
+// Redraw the prompt and the line. A line too long for the terminal is
+// scrolled sideways so the cursor stays visible.
+static void refresh(Editor *e) {
+  size_t cols = terminal_width();
+  size_t avail = cols > e->prompt_len + 1 ? cols - e->prompt_len - 1 : 1;
+  size_t start = e->pos > avail ? e->pos - avail : 0;
+  size_t shown = e->len - start < avail ? e->len - start : avail;
+
+  OutBuf o = {0};
+  char seq[32];
+  out_append(&o, "\r", 1);
+  out_append(&o, e->prompt, e->prompt_len);
+  out_append(&o, e->buf + start, shown);
+  out_append(&o, "\x1b[0K\r", 5); // Clear the rest, back to column 0
+  size_t column = e->prompt_len + e->pos - start;
+  if (column > 0) {
+    int n = snprintf(seq, sizeof(seq), "\x1b[%zuC", column);
+    out_append(&o, seq, n);
+  }
+  out_flush(&o);
+}
+
+static int ensure_cap(Editor *e, size_t need) {
+  if (need + 1 <= e->cap)
+    return 0;
+  size_t cap = e->cap ? e->cap : 128;
+  while (cap < need + 1)
+    cap *= 2;
+  char *grown = realloc(e->buf, cap);
+  if (!grown) {
+    perror("realloc");
+    return -1;
+  }
+  e->buf = grown;
+  e->cap = cap;
+  return 0;
+}
+
+static void insert(Editor *e, const char *s, size_t n) {
+  if (ensure_cap(e, e->len + n) != 0)
+    return;
+  memmove(e->buf + e->pos + n, e->buf + e->pos, e->len - e->pos);
+  memcpy(e->buf + e->pos, s, n);
+  e->len += n;
+  e->pos += n;
+  e->buf[e->len] = '\0';
+}
+
+// Remove the bytes in [from, to) and leave the cursor at from
+static void delete_range(Editor *e, size_t from, size_t to) {
+  memmove(e->buf + from, e->buf + to, e->len - to);
+  e->len -= to - from;
+  e->pos = from;
+  e->buf[e->len] = '\0';
+}
+
+static void set_line(Editor *e, const char *s) {
+  size_t n = strlen(s);
+  if (ensure_cap(e, n) != 0)
+    return;
+  memcpy(e->buf, s, n + 1);
+  e->len = e->pos = n;
+}
+
+// Step through the history; older is 1 for the up arrow
+static void history_step(Editor *e, int older) {
+  size_t total = history_length();
+  if (older && e->history_index < total) {
+    if (e->history_index == 0) {
+      free(e->saved);
+      e->saved = strdup(e->buf);
+    }
+    e->history_index++;
+  } else if (!older && e->history_index > 0) {
+    e->history_index--;
+  } else {
+    return;
+  }
+  const char *entry = e->history_index == 0
+                          ? e->saved
+                          : history_entry(total - e->history_index + 1);
+  set_line(e, entry ? entry : "");
+}
+
+// --- Tab completion ---
+
+static int breaks_word(char c) {
+  return isspace((unsigned char)c) || strchr("|;&<>", c);
+}
+
+typedef struct {
+  char **names;
+  size_t count, cap, widest;
+} MatchList;
+
+static void collect_match(const char *name, void *arg) {
+  MatchList *m = arg;
+  if (m->count == m->cap) {
+    size_t cap = m->cap ? m->cap * 2 : 64;
+    char **grown = realloc(m->names, cap * sizeof(char *));
+    if (!grown)
+      return;
+    m->names = grown;
+    m->cap = cap;
+  }
+  char *copy = strdup(name); // Command names live on the walk's stack
+  if (!copy)
+    return;
+  m->names[m->count++] = copy;
+  size_t width = strlen(name);
+  if (width > m->widest)
+    m->widest = width;
+}
+
+static int read_key(void);
+
+// Print every match in columns below the line, sorted down the columns
+static void list_matches(Editor *e, const Completion *c) {
+  if (c->count > LIST_CONFIRM_COUNT) {
+    char question[64];
+    snprintf(question, sizeof(question),
+             "\nDisplay all %zu possibilities? (y or n)", c->count);
+    write_str(question);
+    int key = read_key();
+    if (key != 'y' && key != 'Y') {
+      write_str("\n");
+      refresh(e);
+      return;
+    }
+  }
+
+  MatchList m = {0};
+  completion_each(c, collect_match, &m);
+  size_t column_width = m.widest + 2;
+  size_t columns = terminal_width() / column_width;
+  if (columns == 0)
+    columns = 1;
+  size_t rows = (m.count + columns - 1) / columns;
+
+  OutBuf o = {0};
+  out_append(&o, "\n", 1);
+  for (size_t r = 0; r < rows; r++) {
+    for (size_t col = 0; col < columns; col++) {
+      size_t i = col * rows + r;
+      if (i >= m.count)
+        break;
+      size_t n = strlen(m.names[i]);
+      out_append(&o, m.names[i], n);
+      if (col + 1 < columns && i + rows < m.count) {
+        for (size_t pad = n; pad < column_width; pad++)
+          out_append(&o, " ", 1);
+      }
+    }
+    out_append(&o, "\n", 1);
+  }
+  out_flush(&o);
+  for (size_t i = 0; i < m.count; i++)
+    free(m.names[i]);
+  free(m.names);
+  refresh(e);
+}
+
+// Complete the word before the cursor as far as it is unambiguous. A
+// single match is finished off with a space, or a '/' for a directory;
+// when nothing can be added the matches are listed instead.
+static void complete(Editor *e) {
+  size_t start = e->pos;
+  while (start > 0 && !breaks_word(e->buf[start - 1]))
+    start--;
+  size_t before = start;
+  while (before > 0 && isspace((unsigned char)e->buf[before - 1]))
+    before--;
+  int command_position = before == 0 || strchr("|;&", e->buf[before - 1]);
+
+  Completion c;
+  size_t word_len = e->pos - start;
+  if (complete_word(e->buf + start, word_len, command_position, &c) != 0 ||
+      c.count == 0) {
+    write_str("\a");
+    completion_free(&c);
+    return;
+  }
+
+  // common covers the part after the last '/'
+  const char *slash = memrchr(e->buf + start, '/', word_len);
+  size_t typed = slash ? (size_t)(e->buf + e->pos - slash - 1) : word_len;
+  size_t common_len = strlen(c.common);
+  if (common_len > typed)
+    insert(e, c.common + typed, common_len - typed);
+  if (c.count == 1)
+    insert(e, c.is_dir ? "/" : " ", 1);
+  else if (common_len == typed)
+    list_matches(e, &c);
+  completion_free(&c);
+}
+
+// --- Input ---
+
+// Wait for a key. Background jobs that finish meanwhile are reported and
+// the line is drawn again below the report.
+static int wait_for_key(Editor *e) {
+  struct pollfd fds[2] = {{.fd = STDIN_FILENO, .events = POLLIN},
+                          {.fd = g_sigchld_pipe[0], .events = POLLIN}};
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    if ((fds[1].revents & POLLIN) && handle_sigchld_events() > 0) {
+      write_str("\r\x1b[0K");
+      notify_job_changes();
+      fflush(stdout);
+      refresh(e);
+    }
+    if (fds[0].revents)
+      return 0;
+  }
+}
+
+static int read_byte(void) {
+  unsigned char c;
+  for (;;) {
+    ssize_t n = read(STDIN_FILENO, &c, 1);
+    if (n == 1)
+      return c;
+    if (n < 0 && errno == EINTR)
+      continue;
+    return -1;
+  }
+}
+
+// One key: a byte, or one of the KEY_ codes for an escape sequence
+static int read_key(void) {
+  int c = read_byte();
+  if (c != '\x1b')
+    return c;
+  int kind = read_byte();
+  int code = read_byte();
+  if (kind == 'O') {
+    return code == 'H' ? KEY_HOME : code == 'F' ? KEY_END : KEY_NONE;
+  }
+  if (kind != '[')
+    return KEY_NONE;
+  if (code >= '0' && code <= '9') {
+    if (read_byte() != '~')
+      return KEY_NONE;
+    switch (code) {
+    case '1':
+    case '7':
+      return KEY_HOME;
+    case '3':
+      return KEY_DELETE;
+    case '4':
+    case '8':
+      return KEY_END;
+    }
+    return KEY_NONE;
+  }
+  switch (code) {
+  case 'A':
+    return KEY_UP;
+  case 'B':
+    return KEY_DOWN;
+  case 'C':
+    return KEY_RIGHT;
+  case 'D':
+    return KEY_LEFT;
+  case 'H':
+    return KEY_HOME;
+  case 'F':
+    return KEY_END;
+  }
+  return KEY_NONE;
+}
+
+// Handle one key. Returns 1 when the line is finished, 2 when it was
+// dropped, -1 at EOF and 0 to keep editing.
+static int edit_key(Editor *e, int key) {
+  switch (key) {
+  case '\r':
+  case '\n':
+    return 1;
+  case CTRL_KEY('C'):
+    write_str("^C\n");
+    e->len = e->pos = 0;
+    e->buf[0] = '\0';
+    return 2;
+  case CTRL_KEY('D'):
+    if (e->len == 0)
+      return -1;
+    /* fall through */
+  case KEY_DELETE:
+    if (e->pos < e->len)
+      delete_range(e, e->pos, e->pos + 1);
+    break;
+  case CTRL_KEY('H'):
+  case 127:
+    if (e->pos > 0)
+      delete_range(e, e->pos - 1, e->pos);
+    break;
+  case '\t':
+    complete(e);
+    break;
+  case CTRL_KEY('A'):
+  case KEY_HOME:
+    e->pos = 0;
+    break;
+  case CTRL_KEY('E'):
+  case KEY_END:
+    e->pos = e->len;
+    break;
+  case CTRL_KEY('B'):
+  case KEY_LEFT:
+    if (e->pos > 0)
+      e->pos--;
+    break;
+  case CTRL_KEY('F'):
+  case KEY_RIGHT:
+    if (e->pos < e->len)
+      e->pos++;
+    break;
+  case CTRL_KEY('P'):
+  case KEY_UP:
+    history_step(e, 1);
+    break;
+  case CTRL_KEY('N'):
+  case KEY_DOWN:
+    history_step(e, 0);
+    break;
+  case CTRL_KEY('U'):
+    delete_range(e, 0, e->pos);
+    break;
+  case CTRL_KEY('K'):
+    delete_range(e, e->pos, e->len);
+    e->pos = e->len;
+    break;
+  case CTRL_KEY('W'): {
+    size_t from = e->pos;
+    while (from > 0 && isspace((unsigned char)e->buf[from - 1]))
+      from--;
+    while (from > 0 && !isspace((unsigned char)e->buf[from - 1]))
+      from--;
+    delete_range(e, from, e->pos);
+    break;
+  }
+  case CTRL_KEY('L'):
+    write_str("\x1b[H\x1b[2J");
+    break;
+  default:
+    if (key >= 32 && key < 256) {
+      char c = key;
+      insert(e, &c, 1);
+    }
+    break;
+  }
+  refresh(e);
+  return 0;
+}
+
+ssize_t line_edit(const char *prompt, size_t prompt_len, char **line,
+                  size_t *cap) {
+  Editor e = {.prompt = prompt,
+              .prompt_len = prompt_len,
+              .buf = *line,
+              .cap = *cap};
+  fflush(stdout);
+
+  struct termios saved, raw;
+  int have_tty = tcgetattr(STDIN_FILENO, &saved) == 0;
+  if (have_tty) {
+    raw = saved;
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    // TCSADRAIN, not TCSAFLUSH: keep what was typed ahead
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+  }
+
+  ssize_t result = -1;
+  if (ensure_cap(&e, 0) == 0) {
+    e.buf[0] = '\0';
+    refresh(&e);
+    for (;;) {
+      int key = wait_for_key(&e) == 0 ? read_key() : -1;
+      int done = key < 0 ? -1 : edit_key(&e, key);
+      if (done == 1) {
+        e.pos = e.len; // Leave the whole line on screen
+        refresh(&e);
+        write_str("\n");
+      }
+      if (done > 0) {
+        result = e.len;
+        break;
+      }
+      if (done < 0)
+        break;
+    }
+  }
+
+  if (have_tty)
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &saved);
+  free(e.saved);
+  *line = e.buf;
+  *cap = e.cap;
+  return result;
+}
@@ -1,65 +1,36 @@
-#include "../include/intrinsics.h"
+#include "../include/history.h"
 #include "../include/io.h"
 #include "../include/jobs.h"
-#include "../include/parser.h"
 #include "../include/shell.h"
 
-// --- Global Variable Definitions ---
-pid_t g_fg_pgid = 0;
-char g_shell_home_dir[PATH_MAX];
-
-void sigint_handler(int sig) {
-  (void)sig; // Suppress unused variable warning
-  if (g_fg_pgid > 0) {
-    kill(-g_fg_pgid, SIGINT);
-  } else {
-    // When no foreground job, print a newline and redisplay prompt
-    printf("\n");
-    if (isatty(STDIN_FILENO)) {
-      display_prompt();
-    }
-  }
+static void usage(void) {
+  fprintf(stderr, "Usage: shell.out [-c command | script]\n");
 }
 
-void sigtstp_handler(int sig) {
-  (void)sig; // Suppress unused variable warning
-  if (g_fg_pgid > 0) {
-    kill(-g_fg_pgid, SIGTSTP);
-  }
-}
-
-void shell_loop(void) {
-  char input[MAX_INPUT_SIZE];
-  ASTNode *ast = NULL;
-
-  while (1) {
-    check_background_jobs();
-    if (isatty(STDIN_FILENO)) {
-      display_prompt();
-    }
+int main(int argc, char **argv) {
+  LineSource src;
 
-    if (fgets(input, MAX_INPUT_SIZE, stdin) == NULL) {
-      // This is now only reached on Ctrl-D (EOF) due to SA_RESTART
-      if (isatty(STDIN_FILENO))
-        printf("\n");
-      break; // Correctly exit the loop on EOF
+  // --- Pick the input: -c string, script file or stdin ---
+  if (argc > 1 && strcmp(argv[1], "-c") == 0) {
+    if (argc < 3) {
+      usage();
+      return 2;
     }
-
-    // Ignore empty input or comments
-    if (strlen(input) > 0 && input[0] != '\n' && input[0] != '#') {
-      input[strcspn(input, "\n")] = 0; // Remove trailing newline
-      add_to_history(input);
-      ast = parse_input(input);
-      if (ast) {
-        execute_ast(ast);
-        free_ast(ast);
-      }
+    line_source_from_string(&src, argv[2]);
+  } else if (argc > 1) {
+    if (line_source_from_file(&src, argv[1]) != 0) {
+      perror(argv[1]);
+      return 127;
     }
-    // The loop correctly continues to the next iteration from here.
+  } else {
+    line_source_from_stream(&src, stdin);
+    g_interactive = isatty(STDIN_FILENO);
+    // Edit lines in place unless the terminal cannot take escape codes
+    const char *term = getenv("TERM");
+    src.edit = g_interactive && isatty(STDOUT_FILENO) &&
+               !(term && strcmp(term, "dumb") == 0);
   }
-}
 
-int main(void) {
   // --- Initialize Shell Home Directory ---
   if (getcwd(g_shell_home_dir, sizeof(g_shell_home_dir)) == NULL) {
     perror("Failed to get shell home directory");
@@ -90,16 +61,32 @@ int main(void) {
   signal(SIGTTIN, SIG_IGN); // Ignore terminal input for background processes
   signal(SIGTTOU, SIG_IGN); // Ignore terminal output for background processes
 
-  // Set shell's process group and take control of the terminal
-  if (isatty(STDIN_FILENO)) {
+  // Set shell's process group and take control of the terminal; batch mode
+  // leaves both alone
+  if (g_interactive) {
     pid_t shell_pgid = getpid();
     setpgid(shell_pgid, shell_pgid);
     tcsetpgrp(STDIN_FILENO, shell_pgid);
   }
 
   init_jobs();
+
+  // SIGCHLD Handler: only wakes up the main loop, reaping happens there
+  struct sigaction sa_chld;
+  sa_chld.sa_handler = sigchld_handler;
+  sigemptyset(&sa_chld.sa_mask);
+  sa_chld.sa_flags = SA_RESTART;
+  if (sigaction(SIGCHLD, &sa_chld, NULL) == -1) {
+    perror("sigaction");
+  }
+
   init_history();
-  shell_loop();
+  shell_loop(&src);
+  line_source_close(&src);
+  // A script's queued jobs still get to run
+  if (!g_interactive)
+    drain_job_queue();
 
-  return EXIT_SUCCESS;
+  // Batch mode exits with the status of the last command
+  return g_last_status;
 }
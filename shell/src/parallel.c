@@ -0,0 +1,350 @@
+#define _GNU_SOURCE // memfd_create
+#include "../include/intrinsics.h"
+#include "../include/jobs.h"
+#include "../include/launch.h"
+#include "../include/pathcache.h"
+#include <sys/mman.h>
+
+#define PARALLEL_READ_SIZE 65536
+
+// Input items, one per line. stdin's stdio buffer can hold input meant
+// for the shell itself, so the descriptor is read directly.
+typedef struct {
+  char *buf;
+  size_t start, end, cap;
+  int eof;
+} ItemReader;
+
+// A running worker
+typedef struct {
+  pid_t pid;     // 0 while the slot is free
+  int out_fd;    // Memory file collecting the item's output
+  char *command; // The item's command line, for the report
+} Slot;
+
+// Next non-empty line, valid until the following call; NULL at the end
+static char *next_item(ItemReader *r) {
+  for (;;) {
+    char *line = r->buf + r->start;
+    char *nl = r->start < r->end ? memchr(line, '\n', r->end - r->start) : NULL;
+    if (nl) {
+      *nl = '\0';
+      r->start = nl - r->buf + 1;
+      if (*line)
+        return line;
+      continue;
+    }
+    if (r->eof) {
+      if (r->start == r->end)
+        return NULL;
+      r->buf[r->end] = '\0'; // There is always room for this
+      r->start = r->end;
+      return line;
+    }
+
+    if (r->start > 0)
+      memmove(r->buf, line, r->end - r->start);
+    r->end -= r->start;
+    r->start = 0;
+    if (r->end + 1 >= r->cap) {
+      size_t cap = r->cap ? r->cap * 2 : PARALLEL_READ_SIZE;
+      char *grown = realloc(r->buf, cap);
+      if (!grown) {
+        perror("realloc");
+        return NULL;
+      }
+      r->buf = grown;
+      r->cap = cap;
+    }
+    ssize_t n = read(STDIN_FILENO, r->buf + r->end, r->cap - r->end - 1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      r->eof = 1;
+    else
+      r->end += n;
+  }
+}
+
+// Copy of arg with every {} replaced by item
+static char *substitute(const char *arg, const char *item) {
+  size_t item_len = strlen(item);
+  size_t len = 0;
+  for (const char *p = arg; *p; p++) {
+    if (p[0] == '{' && p[1] == '}') {
+      len += item_len;
+      p++;
+    } else {
+      len++;
+    }
+  }
+  char *out = malloc(len + 1);
+  if (!out)
+    return NULL;
+  char *q = out;
+  for (const char *p = arg; *p; p++) {
+    if (p[0] == '{' && p[1] == '}') {
+      memcpy(q, item, item_len);
+      q += item_len;
+      p++;
+    } else {
+      *q++ = *p;
+    }
+  }
+  *q = '\0';
+  return out;
+}
+
+// Words joined by single spaces
+static char *join_words(char **words) {
+  size_t len = 1;
+  for (int i = 0; words[i]; i++)
+    len += strlen(words[i]) + 1;
+  char *out = malloc(len);
+  if (!out)
+    return NULL;
+  char *p = out;
+  for (int i = 0; words[i]; i++) {
+    size_t n = strlen(words[i]);
+    if (i > 0)
+      *p++ = ' ';
+    memcpy(p, words[i], n);
+    p += n;
+  }
+  *p = '\0';
+  return out;
+}
+
+// argv for one item: the template with {} substituted, or with the item
+// appended when the template has no {}
+static char **build_argv(char **template, int count, const char *item) {
+  int has_placeholder = 0;
+  for (int i = 0; i < count; i++)
+    has_placeholder |= strstr(template[i], "{}") != NULL;
+
+  char **argv = calloc(count + 2, sizeof(char *));
+  if (!argv)
+    return NULL;
+  int n = 0;
+  for (; n < count; n++) {
+    if (!(argv[n] = substitute(template[n], item)))
+      goto fail;
+  }
+  if (!has_placeholder && !(argv[n++] = strdup(item)))
+    goto fail;
+  return argv;
+fail:
+  for (int i = 0; i < n; i++)
+    free(argv[i]);
+  free(argv);
+  return NULL;
+}
+
+static void free_argv(char **argv) {
+  for (int i = 0; argv[i]; i++)
+    free(argv[i]);
+  free(argv);
+}
+
+static pid_t start_worker(CommandNode *cmd, pid_t pgid, int in_fd,
+                          int out_fd) {
+  int is_external = !runs_as_builtin(cmd, in_fd);
+  const char *path = is_external ? path_cache_lookup(cmd->args[0]) : NULL;
+  pid_t pid;
+  if (g_launch_mode == LAUNCH_SPAWN && is_external) {
+    pid = spawn_process(cmd, path, pgid, 1, in_fd, out_fd);
+  } else {
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0)
+      launch_process(cmd, path, pgid, 1, in_fd, out_fd, 1);
+    if (pid < 0)
+      perror("fork");
+  }
+  if (pid > 0)
+    setpgid(pid, pgid ? pgid : pid);
+  return pid;
+}
+
+// Write out everything a finished worker produced, in one piece, and
+// empty the file for the slot's next item
+static void flush_output(int fd) {
+  char buf[PARALLEL_READ_SIZE];
+  ssize_t n;
+  fflush(stdout);
+  if (lseek(fd, 0, SEEK_SET) < 0)
+    return;
+  while ((n = read(fd, buf, sizeof(buf))) > 0) {
+    ssize_t off = 0;
+    while (off < n) {
+      ssize_t w = write(STDOUT_FILENO, buf + off, n - off);
+      if (w < 0 && errno == EINTR)
+        continue;
+      if (w < 0)
+        break; // Reader went away, drop the rest
+      off += w;
+    }
+    if (off < n)
+      break;
+  }
+  // The offset is shared with the next worker, which must start at 0
+  if (ftruncate(fd, 0) < 0 || lseek(fd, 0, SEEK_SET) < 0)
+    perror("parallel");
+}
+
+// parallel [-j N] [-v] command [args...]: run command once per input
+// line, at most N at a time (default: one per CPU). {} in the arguments
+// stands for the line; without it the line is appended. Each item's output
+// is held in a memory file and written out whole when the item finishes,
+// so items never interleave. Failed items are reported on stderr, and with
+// -v every item's exit status is.
+//
+// This always runs in a forked child (see needs_own_process), with the
+// workers in its process group, so the job stops and resumes as a whole.
+int builtin_parallel(char **args) {
+  long jobs = sysconf(_SC_NPROCESSORS_ONLN);
+  int verbose = 0;
+  int argi = 1;
+  for (; args[argi] && args[argi][0] == '-'; argi++) {
+    if (strcmp(args[argi], "-v") == 0) {
+      verbose = 1;
+    } else if (strcmp(args[argi], "-j") == 0) {
+      if (!args[argi + 1] || (jobs = atol(args[argi + 1])) < 1) {
+        fprintf(stderr, "parallel: -j needs a positive number\n");
+        return 1;
+      }
+      argi++;
+    } else {
+      break;
+    }
+  }
+  if (!args[argi]) {
+    fprintf(stderr, "Usage: parallel [-j N] [-v] command [args...]\n");
+    return 1;
+  }
+  if (jobs < 1)
+    jobs = 1;
+  char **template = args + argi;
+  int template_count = 0;
+  while (template[template_count])
+    template_count++;
+
+  Slot *slots = calloc(jobs, sizeof(Slot));
+  char *job_command = join_words(args);
+  int null_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  if (!slots || !job_command || null_fd < 0) {
+    perror("parallel");
+    free(slots);
+    free(job_command);
+    if (null_fd >= 0)
+      close(null_fd);
+    return 1;
+  }
+  for (long i = 0; i < jobs; i++)
+    slots[i].out_fd = -1;
+
+  // Ctrl-C reaches the workers through the process group. Outlive it to
+  // report them, and start nothing new.
+  signal(SIGINT, SIG_IGN);
+
+  ItemReader reader = {0};
+  Job *job = NULL;
+  pid_t pgid = getpgrp();
+  long live = 0;
+  int failed = 0;
+  int stop = 0;
+
+  for (;;) {
+    // Keep every slot busy while there is input
+    while (!stop && live < jobs) {
+      char *item = next_item(&reader);
+      if (!item) {
+        stop = 1;
+        break;
+      }
+      Slot *slot = slots;
+      while (slot->pid)
+        slot++;
+      if (slot->out_fd < 0)
+        slot->out_fd = memfd_create("parallel", MFD_CLOEXEC);
+      char **argv = build_argv(template, template_count, item);
+      if (slot->out_fd < 0 || !argv) {
+        perror("parallel");
+        if (argv)
+          free_argv(argv);
+        stop = 1;
+        break;
+      }
+
+      CommandNode cmd = {.type = NODE_COMMAND, .args = argv, .background = 1};
+      while (argv[cmd.arg_count])
+        cmd.arg_count++;
+      pid_t pid = start_worker(&cmd, pgid, null_fd, slot->out_fd);
+      char *command = join_words(argv);
+      free_argv(argv);
+      if (pid < 0) {
+        failed++;
+        free(command);
+        continue;
+      }
+
+      if (!job) {
+        add_job(pgid, job_command, 0, &pid, 1);
+        job = get_job_by_pgid(pgid);
+      } else {
+        job_add_process(job, pid);
+      }
+      slot->pid = pid;
+      slot->command = command;
+      live++;
+    }
+    if (live == 0 || !job)
+      break;
+
+    int status;
+    pid_t pid = wait_job_process(job, &status);
+    if (pid < 0)
+      break;
+    if (WIFSTOPPED(status)) {
+      // A worker stopped on its own; stop the whole job with it, so the
+      // shell sees it stopped. After Ctrl-Z we were stopped as well and
+      // the workers are running again by the time we get here, in which
+      // case the stop is no longer reported.
+      kill(0, SIGSTOP);
+      continue;
+    }
+
+    Slot *slot = slots;
+    while (slot->pid != pid)
+      slot++;
+    live--;
+    flush_output(slot->out_fd);
+    if (WIFSIGNALED(status)) {
+      failed++;
+      fprintf(stderr, "parallel: %s: killed by signal %d\n",
+              slot->command ? slot->command : "", WTERMSIG(status));
+      if (WTERMSIG(status) == SIGINT)
+        stop = 1; // Interrupted: finish what runs, start nothing new
+    } else if (verbose || WEXITSTATUS(status) != 0) {
+      failed += WEXITSTATUS(status) != 0;
+      fprintf(stderr, "parallel: %s: exit status %d\n",
+              slot->command ? slot->command : "", WEXITSTATUS(status));
+    }
+    free(slot->command);
+    slot->command = NULL;
+    slot->pid = 0;
+  }
+
+  if (job)
+    delete_job(job);
+  for (long i = 0; i < jobs; i++) {
+    free(slots[i].command);
+    if (slots[i].out_fd >= 0)
+      close(slots[i].out_fd);
+  }
+  free(slots);
+  free(reader.buf);
+  free(job_command);
+  close(null_fd);
+  return failed ? 1 : 0;
+}
@@ -1,141 +1,244 @@
 #include "../include/parser.h"
-#include <ctype.h> // For isspace()
+#include "../include/vars.h"
 
-// Tokenizer state
-static const char *g_input_stream;
-static char g_current_token[MAX_INPUT_SIZE];
+// Character classes used by the lexer
+enum { CC_WORD = 0, CC_SPACE, CC_META, CC_END };
+
+static const unsigned char char_class[256] = {
+    ['\0'] = CC_END,  [' '] = CC_SPACE,  ['\t'] = CC_SPACE, ['\n'] = CC_SPACE,
+    ['\v'] = CC_SPACE, ['\f'] = CC_SPACE, ['\r'] = CC_SPACE, ['|'] = CC_META,
+    [';'] = CC_META,  ['&'] = CC_META,   ['<'] = CC_META,  ['>'] = CC_META,
+};
+
+typedef enum {
+  TOK_END,
+  TOK_WORD,
+  TOK_PIPE,    // |
+  TOK_SEMI,    // ;
+  TOK_AMP,     // &
+  TOK_IN,      // <
+  TOK_OUT,     // >
+  TOK_APPEND,  // >>
+  TOK_HEREDOC, // <<
+} TokenType;
+
+// A token is a slice of the input line; nothing is copied until the parser
+// turns a word into an argument.
+typedef struct {
+  TokenType type;
+  size_t offset;
+  size_t length;
+  int has_dollar; // A word that needs expanding before each run
+} Token;
+
+// All state of one parse, so parsing is reentrant
+typedef struct {
+  const char *input;
+  size_t pos;    // Lexer position in input
+  Token current; // One-token lookahead
+  Arena *arena;
+  char **args; // Scratch argv of the command being parsed
+  size_t args_cap;
+  int args_on_heap;
+} Parser;
 
 // Forward declarations for recursive parsing
-static ASTNode *parse_sequence(void);
+static ASTNode *parse_sequence(Parser *ps);
+
+static void next_token(Parser *ps) {
+  const unsigned char *s = (const unsigned char *)ps->input;
+  size_t pos = ps->pos;
+
+  while (char_class[s[pos]] == CC_SPACE)
+    pos++;
 
-static void skip_whitespace() {
-  while (*g_input_stream && isspace((unsigned char)*g_input_stream)) {
-    g_input_stream++;
+  Token *tok = &ps->current;
+  tok->offset = pos;
+  switch (char_class[s[pos]]) {
+  case CC_END:
+    tok->type = TOK_END;
+    break;
+  case CC_META:
+    switch (s[pos++]) {
+    case '|':
+      tok->type = TOK_PIPE;
+      break;
+    case ';':
+      tok->type = TOK_SEMI;
+      break;
+    case '&':
+      tok->type = TOK_AMP;
+      break;
+    case '<':
+      tok->type = TOK_IN;
+      if (s[pos] == '<') {
+        tok->type = TOK_HEREDOC;
+        pos++;
+      }
+      break;
+    default: // '>'
+      tok->type = TOK_OUT;
+      if (s[pos] == '>') {
+        tok->type = TOK_APPEND;
+        pos++;
+      }
+      break;
+    }
+    break;
+  default:
+    tok->type = TOK_WORD;
+    while (char_class[s[pos]] == CC_WORD)
+      pos++;
+    // Variables are looked up when the command runs, not here: the tree
+    // may be cached and run again, or a variable set earlier on the line
+    tok->has_dollar =
+        memchr(s + tok->offset, '$', pos - tok->offset) != NULL;
+    break;
   }
+  tok->length = pos - tok->offset;
+  ps->pos = pos;
 }
 
-static int get_token() {
-  skip_whitespace();
-  if (*g_input_stream == '\0')
-    return 0;
-
-  const char *p = g_input_stream;
-  int len = 0;
+static char *token_text(Parser *ps) {
+  return arena_strndup(ps->arena, ps->input + ps->current.offset,
+                       ps->current.length);
+}
 
-  if (strchr("|;&<>", *p)) {
-    if (*p == '>' && *(p + 1) == '>') {
-      len = 2;
-    } else if (*p == '<' && *(p + 1) == '<') {
-      len = 2;
+static int push_arg(Parser *ps, int index, char *arg) {
+  if ((size_t)index >= ps->args_cap) {
+    size_t cap = ps->args_cap * 2;
+    char **grown;
+    if (ps->args_on_heap) {
+      grown = realloc(ps->args, cap * sizeof(char *));
     } else {
-      len = 1;
+      grown = malloc(cap * sizeof(char *));
+      if (grown)
+        memcpy(grown, ps->args, ps->args_cap * sizeof(char *));
     }
-  } else {
-    while (*p && !isspace((unsigned char)*p) && !strchr("|;&<>", *p)) {
-      p++;
+    if (!grown) {
+      perror("malloc");
+      return -1;
     }
-    len = p - g_input_stream;
+    ps->args = grown;
+    ps->args_cap = cap;
+    ps->args_on_heap = 1;
   }
-
-  strncpy(g_current_token, g_input_stream, len);
-  g_current_token[len] = '\0';
-  g_input_stream += len;
-  return 1;
+  ps->args[index] = arg;
+  return 0;
 }
 
-static int peek(const char *str) {
-  skip_whitespace();
-  return strncmp(g_input_stream, str, strlen(str)) == 0;
+static RedirType redirection_type(TokenType type) {
+  switch (type) {
+  case TOK_IN:
+    return REDIR_IN;
+  case TOK_OUT:
+    return REDIR_OUT;
+  case TOK_APPEND:
+    return REDIR_APPEND;
+  case TOK_HEREDOC:
+    return REDIR_HEREDOC;
+  default:
+    return REDIR_NONE;
+  }
 }
 
-static ASTNode *parse_command() {
-  CommandNode *cmd = calloc(1, sizeof(CommandNode));
-  if (!cmd) {
-    perror("calloc");
+static ASTNode *parse_command(Parser *ps) {
+  CommandNode *cmd = arena_calloc(ps->arena, 1, sizeof(CommandNode));
+  if (!cmd)
     return NULL;
-  }
   cmd->type = NODE_COMMAND;
-  cmd->args = calloc(MAX_ARGS, sizeof(char *));
-  if (!cmd->args) {
-    perror("calloc");
-    free(cmd);
-    return NULL;
-  }
   cmd->redirections = NULL;
 
   Redirection **redir_next = &cmd->redirections;
 
-  while (!peek("|") && !peek(";") && !peek("&") && *g_input_stream != '\0') {
-    RedirType redir_type = REDIR_NONE;
-    if (peek(">>")) {
-      redir_type = REDIR_APPEND;
-    } else if (peek("<<")) {
-      redir_type = REDIR_HEREDOC;
-    } else if (peek(">")) {
-      redir_type = REDIR_OUT;
-    } else if (peek("<")) {
-      redir_type = REDIR_IN;
-    }
+  for (;;) {
+    TokenType type = ps->current.type;
+    RedirType redir_type = redirection_type(type);
 
     if (redir_type != REDIR_NONE) {
-      get_token(); // Consume the redirection operator
-      if (!get_token()) {
+      next_token(ps); // Consume the redirection operator
+      if (ps->current.type != TOK_WORD) {
         fprintf(stderr, "Invalid Syntax!\n");
-        free_ast((ASTNode *)cmd);
         return NULL;
       }
-      Redirection *r = malloc(sizeof(Redirection));
+      Redirection *r = arena_alloc(ps->arena, sizeof(Redirection));
+      if (!r)
+        return NULL;
       r->type = redir_type;
-      r->filename = strdup(g_current_token);
+      r->filename = token_text(ps);
+      cmd->expand |= ps->current.has_dollar;
+      r->body = NULL;
+      r->body_len = 0;
       r->next = NULL;
       *redir_next = r;
       redir_next = &r->next;
+    } else if (type == TOK_WORD) {
+      // NAME=value words before the command name are assignments. They
+      // go first in the scratch argv and are split off at the end.
+      int is_assign = cmd->arg_count == 0 &&
+                      vars_assignment_name(ps->input + ps->current.offset,
+                                           ps->current.length) > 0;
+      char *arg = token_text(ps);
+      int index = cmd->assign_count + cmd->arg_count;
+      if (!arg || push_arg(ps, index, arg) != 0)
+        return NULL;
+      if (is_assign)
+        cmd->assign_count++;
+      else
+        cmd->arg_count++;
+      cmd->expand |= ps->current.has_dollar;
     } else {
-      if (!get_token())
-        break;
-      if (cmd->arg_count < MAX_ARGS - 1) {
-        cmd->args[cmd->arg_count++] = strdup(g_current_token);
-      }
+      break;
     }
+    next_token(ps);
   }
-  cmd->args[cmd->arg_count] = NULL;
 
-  if (cmd->arg_count == 0 && cmd->redirections == NULL) {
-    free_ast((ASTNode *)cmd);
+  if (cmd->arg_count == 0 && cmd->assign_count == 0 &&
+      cmd->redirections == NULL) {
     // Don't print syntax error for empty commands
     return NULL;
   }
+
+  cmd->assigns =
+      arena_alloc(ps->arena, (cmd->assign_count + 1) * sizeof(char *));
+  cmd->args = arena_alloc(ps->arena, (cmd->arg_count + 1) * sizeof(char *));
+  if (!cmd->assigns || !cmd->args)
+    return NULL;
+  memcpy(cmd->assigns, ps->args, cmd->assign_count * sizeof(char *));
+  cmd->assigns[cmd->assign_count] = NULL;
+  memcpy(cmd->args, ps->args + cmd->assign_count,
+         cmd->arg_count * sizeof(char *));
+  cmd->args[cmd->arg_count] = NULL;
   return (ASTNode *)cmd;
 }
 
-static ASTNode *parse_job() {
-  ASTNode *node = parse_command();
+static ASTNode *parse_job(Parser *ps) {
+  ASTNode *node = parse_command(ps);
   if (!node)
     return NULL;
 
-  skip_whitespace();
-  if (peek("&")) {
-    get_token();
+  if (ps->current.type == TOK_AMP) {
+    next_token(ps);
     ((CommandNode *)node)->background = 1;
   }
   return node;
 }
 
-static ASTNode *parse_pipe() {
-  ASTNode *left = parse_job();
+static ASTNode *parse_pipe(Parser *ps) {
+  ASTNode *left = parse_job(ps);
   if (!left)
     return NULL;
 
-  skip_whitespace();
-  if (peek("|")) {
-    get_token();
-    ASTNode *right = parse_pipe();
+  if (ps->current.type == TOK_PIPE) {
+    next_token(ps);
+    ASTNode *right = parse_pipe(ps);
     if (!right) {
       fprintf(stderr, "Invalid Syntax!\n");
-      free_ast(left);
       return NULL;
     }
-    PipeNode *pipe_node = malloc(sizeof(PipeNode));
+    PipeNode *pipe_node = arena_alloc(ps->arena, sizeof(PipeNode));
+    if (!pipe_node)
+      return NULL;
     pipe_node->type = NODE_PIPE;
     pipe_node->left = left;
     pipe_node->right = right;
@@ -144,20 +247,47 @@ static ASTNode *parse_pipe() {
   return left;
 }
 
-static ASTNode *parse_sequence() {
-  ASTNode *left = parse_pipe();
+// True if the current token is the bare word kw
+static int at_keyword(Parser *ps, const char *kw) {
+  size_t len = strlen(kw);
+  return ps->current.type == TOK_WORD && ps->current.length == len &&
+         memcmp(ps->input + ps->current.offset, kw, len) == 0;
+}
+
+// A pipeline, optionally prefixed by `time`
+static ASTNode *parse_pipeline(Parser *ps) {
+  if (!at_keyword(ps, "time"))
+    return parse_pipe(ps);
+
+  next_token(ps);
+  TimeNode *time_node = arena_alloc(ps->arena, sizeof(TimeNode));
+  if (!time_node)
+    return NULL;
+  time_node->type = NODE_TIME;
+  time_node->body = NULL; // A bare `time` just reports zeros
+  if (ps->current.type != TOK_END && ps->current.type != TOK_SEMI) {
+    time_node->body = parse_pipeline(ps);
+    if (!time_node->body)
+      return NULL;
+  }
+  return (ASTNode *)time_node;
+}
+
+static ASTNode *parse_sequence(Parser *ps) {
+  ASTNode *left = parse_pipeline(ps);
   if (!left)
     return NULL;
 
-  skip_whitespace();
-  if (peek(";")) {
-    get_token();
-    ASTNode *right = parse_sequence();
+  if (ps->current.type == TOK_SEMI) {
+    next_token(ps);
+    ASTNode *right = parse_sequence(ps);
     if (!right) {
       // Allow trailing semicolon
       return left;
     }
-    SequenceNode *seq_node = malloc(sizeof(SequenceNode));
+    SequenceNode *seq_node = arena_alloc(ps->arena, sizeof(SequenceNode));
+    if (!seq_node)
+      return NULL;
     seq_node->type = NODE_SEQUENCE;
     seq_node->left = left;
     seq_node->right = right;
@@ -166,43 +296,22 @@ static ASTNode *parse_sequence() {
   return left;
 }
 
-ASTNode *parse_input(const char *input) {
-  g_input_stream = input;
-  ASTNode *ast = parse_sequence();
-  skip_whitespace();
-  if (*g_input_stream != '\0') {
+ASTNode *parse_input(Arena *arena, const char *input) {
+  char *local_args[MAX_ARGS];
+  Parser ps = {.input = input,
+               .pos = 0,
+               .arena = arena,
+               .args = local_args,
+               .args_cap = MAX_ARGS,
+               .args_on_heap = 0};
+
+  next_token(&ps);
+  ASTNode *ast = parse_sequence(&ps);
+  if (ps.current.type != TOK_END) {
     fprintf(stderr, "Invalid Syntax!\n");
-    free_ast(ast);
-    return NULL;
+    ast = NULL;
   }
+  if (ps.args_on_heap)
+    free(ps.args);
   return ast;
 }
-
-void free_ast(ASTNode *node) {
-  if (!node)
-    return;
-  switch (node->type) {
-  case NODE_COMMAND: {
-    CommandNode *cmd = (CommandNode *)node;
-    for (int i = 0; i < cmd->arg_count; ++i)
-      free(cmd->args[i]);
-    free(cmd->args);
-    Redirection *r = cmd->redirections;
-    while (r) {
-      Redirection *next = r->next;
-      free(r->filename);
-      free(r);
-      r = next;
-    }
-    break;
-  }
-  case NODE_PIPE:
-  case NODE_SEQUENCE: {
-    PipeNode *p = (PipeNode *)node;
-    free_ast(p->left);
-    free_ast(p->right);
-    break;
-  }
-  }
-  free(node);
-}
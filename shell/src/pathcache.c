@@ -0,0 +1,201 @@
+#include "../include/pathcache.h"
+#include "../include/vars.h"
+
+#define PATH_CACHE_INITIAL_BUCKETS 64
+#define PATH_CACHE_DEFAULT_PATH "/bin:/usr/bin" // execvp's, for no $PATH
+
+typedef struct PathEntry {
+  char *name;
+  char *path;
+  unsigned long hits;
+  struct PathEntry *next;
+} PathEntry;
+
+static PathEntry **buckets = NULL;
+static size_t bucket_count = 0;
+static size_t entry_count = 0;
+static char *cached_path_env = NULL; // $PATH the entries were resolved under
+static unsigned long total_hits = 0;
+static unsigned long total_misses = 0;
+
+// FNV-1a
+static size_t hash_name(const char *name) {
+  size_t h = 2166136261u;
+  for (const unsigned char *p = (const unsigned char *)name; *p; p++) {
+    h ^= *p;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static void free_entry(PathEntry *e) {
+  free(e->name);
+  free(e->path);
+  free(e);
+}
+
+void path_cache_clear(void) {
+  for (size_t i = 0; i < bucket_count; i++) {
+    PathEntry *e = buckets[i];
+    while (e) {
+      PathEntry *next = e->next;
+      free_entry(e);
+      e = next;
+    }
+    buckets[i] = NULL;
+  }
+  entry_count = 0;
+}
+
+// Drop the whole table if $PATH no longer matches what it was built from.
+static void check_path_env(void) {
+  const char *path_env = vars_get("PATH");
+  if (!path_env)
+    path_env = PATH_CACHE_DEFAULT_PATH;
+  if (cached_path_env && strcmp(cached_path_env, path_env) == 0)
+    return;
+  path_cache_clear();
+  free(cached_path_env);
+  cached_path_env = strdup(path_env);
+}
+
+static int grow_table(void) {
+  size_t new_count =
+      bucket_count ? bucket_count * 2 : PATH_CACHE_INITIAL_BUCKETS;
+  PathEntry **new_buckets = calloc(new_count, sizeof(PathEntry *));
+  if (!new_buckets) {
+    perror("calloc");
+    return -1;
+  }
+  for (size_t i = 0; i < bucket_count; i++) {
+    PathEntry *e = buckets[i];
+    while (e) {
+      PathEntry *next = e->next;
+      size_t idx = hash_name(e->name) & (new_count - 1);
+      e->next = new_buckets[idx];
+      new_buckets[idx] = e;
+      e = next;
+    }
+  }
+  free(buckets);
+  buckets = new_buckets;
+  bucket_count = new_count;
+  return 0;
+}
+
+static PathEntry **find_slot(const char *name) {
+  PathEntry **slot = &buckets[hash_name(name) & (bucket_count - 1)];
+  while (*slot && strcmp((*slot)->name, name) != 0)
+    slot = &(*slot)->next;
+  return slot;
+}
+
+// Walk $PATH the way execvp does. Returns a malloc'd path or NULL. From
+// a relative element on (empty means the current directory) the answer
+// changes with every hop, so the search stops there with NULL and is left
+// to execvp.
+static char *resolve_on_path(const char *name) {
+  const char *dir = cached_path_env;
+  char candidate[PATH_MAX];
+  struct stat st;
+
+  while (dir && *dir == '/') {
+    const char *end = strchr(dir, ':');
+    size_t dir_len = end ? (size_t)(end - dir) : strlen(dir);
+    int n = snprintf(candidate, sizeof(candidate), "%.*s/%s", (int)dir_len,
+                     dir, name);
+    if (n > 0 && (size_t)n < sizeof(candidate) &&
+        stat(candidate, &st) == 0 && S_ISREG(st.st_mode) &&
+        access(candidate, X_OK) == 0) {
+      return strdup(candidate);
+    }
+    dir = end ? end + 1 : NULL;
+  }
+  return NULL;
+}
+
+static PathEntry *insert_entry(const char *name, char *path) {
+  if ((bucket_count == 0 || entry_count >= bucket_count) && grow_table() != 0) {
+    free(path);
+    return NULL;
+  }
+  PathEntry *e = malloc(sizeof(PathEntry));
+  if (!e) {
+    perror("malloc");
+    free(path);
+    return NULL;
+  }
+  e->name = strdup(name);
+  e->path = path;
+  e->hits = 0;
+  PathEntry **slot = &buckets[hash_name(name) & (bucket_count - 1)];
+  e->next = *slot;
+  *slot = e;
+  entry_count++;
+  return e;
+}
+
+const char *path_cache_lookup(const char *name) {
+  if (!name || !*name || strchr(name, '/'))
+    return NULL;
+  check_path_env();
+
+  if (bucket_count > 0) {
+    PathEntry **slot = find_slot(name);
+    PathEntry *e = *slot;
+    if (e) {
+      // One access() instead of a failed execve per $PATH element
+      if (access(e->path, X_OK) == 0) {
+        e->hits++;
+        total_hits++;
+        return e->path;
+      }
+      *slot = e->next; // Stale: the binary moved or lost its x bit
+      free_entry(e);
+      entry_count--;
+    }
+  }
+
+  total_misses++;
+  char *path = resolve_on_path(name);
+  if (!path)
+    return NULL;
+  PathEntry *e = insert_entry(name, path);
+  return e ? e->path : NULL;
+}
+
+int path_cache_add(const char *name) {
+  if (strchr(name, '/'))
+    return -1;
+  check_path_env();
+  char *path = resolve_on_path(name);
+  if (!path)
+    return -1;
+  if (bucket_count > 0) {
+    PathEntry *e = *find_slot(name);
+    if (e) {
+      free(e->path);
+      e->path = path;
+      return 0;
+    }
+  }
+  return insert_entry(name, path) ? 0 : -1;
+}
+
+void path_cache_print(void) {
+  if (entry_count == 0) {
+    printf("hash: hash table empty\n");
+    return;
+  }
+  printf("hits\tcommand\n");
+  for (size_t i = 0; i < bucket_count; i++) {
+    for (PathEntry *e = buckets[i]; e; e = e->next) {
+      printf("%4lu\t%s\n", e->hits, e->path);
+    }
+  }
+}
+
+void path_cache_stats(unsigned long *hits, unsigned long *misses) {
+  *hits = total_hits;
+  *misses = total_misses;
+}
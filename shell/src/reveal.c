@@ -0,0 +1,291 @@
+#define _GNU_SOURCE // getdents64
+#include "../include/intrinsics.h"
+#include <grp.h>
+#include <time.h>
+
+#define REVEAL_DENTS_BUF (256 * 1024)
+#define REVEAL_OUT_FLUSH (1024 * 1024)
+#define REVEAL_ID_CACHE 16
+
+// Growable byte buffer for names and for output
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+} Buffer;
+
+static int buf_reserve(Buffer *b, size_t extra) {
+  if (b->len + extra <= b->cap)
+    return 0;
+  size_t cap = b->cap ? b->cap : 4096;
+  while (cap < b->len + extra)
+    cap *= 2;
+  char *grown = realloc(b->data, cap);
+  if (!grown) {
+    perror("realloc");
+    return -1;
+  }
+  b->data = grown;
+  b->cap = cap;
+  return 0;
+}
+
+static void buf_append(Buffer *b, const char *s, size_t n) {
+  if (buf_reserve(b, n) == 0) {
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+  }
+}
+
+static void buf_flush(Buffer *b) {
+  if (b->len == 0)
+    return; // data is still NULL for an empty directory
+  fwrite(b->data, 1, b->len, stdout);
+  b->len = 0;
+}
+
+// Helper function for qsort to compare two strings
+static int compare_strings(const void *a, const void *b) {
+  return strcmp(*(const char **)a, *(const char **)b);
+}
+
+// uid/gid -> name, remembered because a directory is usually owned by a
+// handful of ids
+typedef struct {
+  unsigned int id;
+  char name[32];
+} IdName;
+
+static const char *cached_id_name(IdName *cache, int *count, unsigned int id,
+                                  int is_group) {
+  for (int i = 0; i < *count; i++) {
+    if (cache[i].id == id)
+      return cache[i].name;
+  }
+  IdName *slot = &cache[*count < REVEAL_ID_CACHE ? (*count)++
+                                                  : id % REVEAL_ID_CACHE];
+  slot->id = id;
+  const char *name = NULL;
+  if (is_group) {
+    struct group *gr = getgrgid(id);
+    name = gr ? gr->gr_name : NULL;
+  } else {
+    struct passwd *pw = getpwuid(id);
+    name = pw ? pw->pw_name : NULL;
+  }
+  if (name)
+    snprintf(slot->name, sizeof(slot->name), "%s", name);
+  else
+    snprintf(slot->name, sizeof(slot->name), "%u", id);
+  return slot->name;
+}
+
+static void format_mode(mode_t mode, char *out) {
+  out[0] = S_ISDIR(mode)    ? 'd'
+           : S_ISLNK(mode)  ? 'l'
+           : S_ISCHR(mode)  ? 'c'
+           : S_ISBLK(mode)  ? 'b'
+           : S_ISFIFO(mode) ? 'p'
+           : S_ISSOCK(mode) ? 's'
+                            : '-';
+  const char *rwx = "rwxrwxrwx";
+  for (int i = 0; i < 9; i++)
+    out[i + 1] = (mode & (0400 >> i)) ? rwx[i] : '-';
+  if (mode & S_ISUID)
+    out[3] = (mode & S_IXUSR) ? 's' : 'S';
+  if (mode & S_ISGID)
+    out[6] = (mode & S_IXGRP) ? 's' : 'S';
+  if (mode & S_ISVTX)
+    out[9] = (mode & S_IXOTH) ? 't' : 'T';
+  out[10] = '\0';
+}
+
+// Print "mode links owner group size mtime name" for every entry, with
+// metadata read relative to the open directory
+static void print_long(int dir_fd, char **entries, size_t count,
+                       Buffer *out) {
+  struct stat *stats = malloc(count * sizeof(struct stat));
+  if (!stats && count > 0) {
+    perror("malloc");
+    return;
+  }
+  IdName users[REVEAL_ID_CACHE], groups[REVEAL_ID_CACHE];
+  int user_count = 0, group_count = 0;
+  int w_links = 1, w_user = 1, w_group = 1, w_size = 1;
+
+  // First pass: metadata and column widths
+  for (size_t i = 0; i < count; i++) {
+    struct stat *st = &stats[i];
+    char num[32];
+    if (fstatat(dir_fd, entries[i], st, AT_SYMLINK_NOFOLLOW) != 0) {
+      memset(st, 0, sizeof(*st));
+      continue;
+    }
+    int n = snprintf(num, sizeof(num), "%lu", (unsigned long)st->st_nlink);
+    if (n > w_links)
+      w_links = n;
+    n = snprintf(num, sizeof(num), "%lld", (long long)st->st_size);
+    if (n > w_size)
+      w_size = n;
+    n = strlen(cached_id_name(users, &user_count, st->st_uid, 0));
+    if (n > w_user)
+      w_user = n;
+    n = strlen(cached_id_name(groups, &group_count, st->st_gid, 1));
+    if (n > w_group)
+      w_group = n;
+  }
+
+  // Second pass: format into the output buffer
+  time_t last_mtime = (time_t)-1;
+  char date[32] = "";
+  for (size_t i = 0; i < count; i++) {
+    struct stat *st = &stats[i];
+    char mode[11];
+    char line[512];
+
+    format_mode(st->st_mode, mode);
+    if (st->st_mtime != last_mtime) { // Runs of equal mtimes are common
+      struct tm tm;
+      last_mtime = st->st_mtime;
+      if (localtime_r(&last_mtime, &tm))
+        strftime(date, sizeof(date), "%b %e %H:%M", &tm);
+    }
+    int n = snprintf(line, sizeof(line), "%s %*lu %-*s %-*s %*lld %s ", mode,
+                     w_links, (unsigned long)st->st_nlink, w_user,
+                     cached_id_name(users, &user_count, st->st_uid, 0),
+                     w_group,
+                     cached_id_name(groups, &group_count, st->st_gid, 1),
+                     w_size, (long long)st->st_size, date);
+    if (n > 0)
+      buf_append(out, line, (size_t)n < sizeof(line) ? (size_t)n
+                                                      : sizeof(line) - 1);
+    buf_append(out, entries[i], strlen(entries[i]));
+    if (S_ISLNK(st->st_mode)) {
+      char target[PATH_MAX];
+      ssize_t len = readlinkat(dir_fd, entries[i], target, sizeof(target));
+      if (len > 0) {
+        buf_append(out, " -> ", 4);
+        buf_append(out, target, len);
+      }
+    }
+    buf_append(out, "\n", 1);
+    if (out->len >= REVEAL_OUT_FLUSH)
+      buf_flush(out);
+  }
+  free(stats);
+}
+
+int builtin_reveal(char **args) {
+  int show_hidden = 0;
+  int long_format = 0;
+  char *target_dir = ".";
+
+  // --- 1. Parse arguments and flags ---
+  for (int i = 1; args[i] != NULL; ++i) {
+    if (args[i][0] == '-') {
+      for (size_t j = 1; j < strlen(args[i]); ++j) {
+        if (args[i][j] == 'a')
+          show_hidden = 1;
+        else if (args[i][j] == 'l')
+          long_format = 1;
+        else {
+          fprintf(stderr, "reveal: invalid option -- '%c'\n", args[i][j]);
+          return 1;
+        }
+      }
+    } else {
+      target_dir = args[i];
+    }
+  }
+
+  int dir_fd = open(target_dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (dir_fd < 0) {
+    perror("reveal");
+    return 1;
+  }
+
+  // --- 2. Read entries in large batches into one name arena ---
+  char *dents = malloc(REVEAL_DENTS_BUF);
+  Buffer names = {0};
+  size_t *offsets = NULL;
+  size_t count = 0, capacity = 0;
+  int ret = 0;
+  if (!dents) {
+    perror("malloc");
+    close(dir_fd);
+    return 1;
+  }
+
+  ssize_t nread;
+  while ((nread = getdents64(dir_fd, dents, REVEAL_DENTS_BUF)) > 0) {
+    for (ssize_t pos = 0; pos < nread;) {
+      struct dirent64 *d = (struct dirent64 *)(dents + pos);
+      pos += d->d_reclen;
+      if (!show_hidden && d->d_name[0] == '.')
+        continue;
+      if (count == capacity) {
+        capacity = capacity ? capacity * 2 : 256;
+        size_t *grown = realloc(offsets, capacity * sizeof(size_t));
+        if (!grown) {
+          perror("realloc");
+          ret = 1;
+          goto out;
+        }
+        offsets = grown;
+      }
+      offsets[count++] = names.len;
+      buf_append(&names, d->d_name, strlen(d->d_name) + 1);
+    }
+  }
+  if (nread < 0) {
+    perror("reveal");
+    ret = 1;
+    goto out;
+  }
+
+  // --- 3. Sort the entries ---
+  // The arena no longer moves, so offsets can become pointers
+  char **entries = malloc((count + 1) * sizeof(char *));
+  if (!entries) {
+    perror("malloc");
+    ret = 1;
+    goto out;
+  }
+  for (size_t i = 0; i < count; i++)
+    entries[i] = names.data + offsets[i];
+  qsort(entries, count, sizeof(char *), compare_strings);
+
+  // --- 4. Assemble the output in one buffer ---
+  Buffer output = {0};
+  if (long_format) {
+    print_long(dir_fd, entries, count, &output);
+  } else if (!isatty(STDOUT_FILENO)) {
+    // One name per line for pipes and files, as ls does
+    for (size_t i = 0; i < count; i++) {
+      buf_append(&output, entries[i], strlen(entries[i]));
+      buf_append(&output, "\n", 1);
+      if (output.len >= REVEAL_OUT_FLUSH)
+        buf_flush(&output);
+    }
+  } else {
+    for (size_t i = 0; i < count; i++) {
+      buf_append(&output, entries[i], strlen(entries[i]));
+      buf_append(&output, "  ", 2);
+      if (output.len >= REVEAL_OUT_FLUSH)
+        buf_flush(&output);
+    }
+    if (count > 0)
+      buf_append(&output, "\n", 1);
+  }
+  buf_flush(&output);
+  free(output.data);
+  free(entries);
+
+  // --- 5. Free all allocated memory ---
+out:
+  free(offsets);
+  free(names.data);
+  free(dents);
+  close(dir_fd);
+  return ret;
+}
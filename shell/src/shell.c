@@ -0,0 +1,226 @@
+#include "../include/astcache.h"
+#include "../include/history.h"
+#include "../include/io.h"
+#include "../include/jobs.h"
+#include "../include/parser.h"
+#include "../include/shell.h"
+#include <poll.h>
+
+// --- Global Variable Definitions ---
+pid_t g_fg_pgid = 0;
+char g_shell_home_dir[PATH_MAX];
+int g_interactive = 0;
+int g_last_status = 0;
+int g_sigchld_pipe[2] = {-1, -1};
+volatile sig_atomic_t g_sigchld_pending = 0;
+volatile sig_atomic_t g_sigint_received = 0;
+
+void sigint_handler(int sig) {
+  (void)sig; // Suppress unused variable warning
+  g_sigint_received = 1;
+  if (g_fg_pgid > 0) {
+    kill(-g_fg_pgid, SIGINT);
+  } else {
+    // When no foreground job, print a newline and redisplay prompt
+    printf("\n");
+    if (g_interactive) {
+      display_prompt();
+    }
+  }
+}
+
+void sigtstp_handler(int sig) {
+  (void)sig; // Suppress unused variable warning
+  if (g_fg_pgid > 0) {
+    kill(-g_fg_pgid, SIGTSTP);
+  }
+}
+
+void sigchld_handler(int sig) {
+  (void)sig; // Suppress unused variable warning
+  int saved_errno = errno;
+  g_sigchld_pending = 1;
+  // Wake up the poll() in wait_for_input; if the pipe is full it already
+  // will, so a failed write is fine
+  ssize_t n = write(g_sigchld_pipe[1], "", 1);
+  (void)n;
+  errno = saved_errno;
+}
+
+// Block until stdin is readable. Background jobs that finish or stop
+// meanwhile are reaped and reported right away instead of at the next
+// prompt.
+static void wait_for_input(void) {
+  struct pollfd fds[2] = {{.fd = STDIN_FILENO, .events = POLLIN},
+                          {.fd = g_sigchld_pipe[0], .events = POLLIN}};
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    if (fds[1].revents & POLLIN) {
+      if (handle_sigchld_events() > 0) {
+        printf("\n");
+        notify_job_changes();
+        display_prompt();
+      }
+    }
+    if (fds[0].revents)
+      return;
+  }
+}
+
+// Here-document bodies follow the command line in the input, so lines
+// using them are parsed into this arena instead of the AST cache
+static Arena heredoc_arena;
+
+// Read the body of one here-document from src, up to a line holding only
+// the delimiter. Quotes around the delimiter are dropped.
+static int read_heredoc(Redirection *r, LineSource *src) {
+  const char *delim = r->filename;
+  size_t delim_len = strlen(delim);
+  if (delim_len >= 2 && (delim[0] == '\'' || delim[0] == '"') &&
+      delim[delim_len - 1] == delim[0]) {
+    delim++;
+    delim_len -= 2;
+  }
+
+  char *body = NULL;
+  size_t len = 0, cap = 0;
+  for (;;) {
+    if (g_interactive && !src->edit) {
+      printf("> ");
+      fflush(stdout);
+    }
+    src->prompt = "> ";
+    ssize_t n = line_source_next(src);
+    src->prompt = NULL;
+    if (n < 0) {
+      fprintf(stderr, "warning: here-document delimited by end-of-file "
+                      "(wanted `%.*s')\n",
+              (int)delim_len, delim);
+      break;
+    }
+    if ((size_t)n == delim_len && memcmp(src->line, delim, delim_len) == 0)
+      break;
+    if (len + n + 1 > cap) {
+      cap = cap ? cap * 2 : 256;
+      while (len + n + 1 > cap)
+        cap *= 2;
+      char *grown = realloc(body, cap);
+      if (!grown) {
+        perror("realloc");
+        free(body);
+        return -1;
+      }
+      body = grown;
+    }
+    memcpy(body + len, src->line, n);
+    len += n;
+    body[len++] = '\n';
+  }
+
+  r->body = arena_alloc(&heredoc_arena, len + 1);
+  if (!r->body) {
+    free(body);
+    return -1;
+  }
+  if (len)
+    memcpy(r->body, body, len);
+  r->body[len] = '\0';
+  r->body_len = len;
+  free(body);
+  return 0;
+}
+
+// Fill in every here-document of the tree, in the order they appear on
+// the line
+static int collect_heredocs(ASTNode *node, LineSource *src) {
+  if (!node)
+    return 0;
+  switch (node->type) {
+  case NODE_COMMAND:
+    for (Redirection *r = ((CommandNode *)node)->redirections; r;
+         r = r->next) {
+      if (r->type == REDIR_HEREDOC && read_heredoc(r, src) != 0)
+        return -1;
+    }
+    return 0;
+  case NODE_PIPE:
+    if (collect_heredocs(((PipeNode *)node)->left, src) != 0)
+      return -1;
+    return collect_heredocs(((PipeNode *)node)->right, src);
+  case NODE_SEQUENCE:
+    if (collect_heredocs(((SequenceNode *)node)->left, src) != 0)
+      return -1;
+    return collect_heredocs(((SequenceNode *)node)->right, src);
+  case NODE_TIME:
+    return collect_heredocs(((TimeNode *)node)->body, src);
+  }
+  return 0;
+}
+
+// Expand, parse and run one command line
+static void run_line(const char *line, LineSource *src) {
+  // Ignore empty input or comments
+  if (line[0] == '\0' || line[0] == '#')
+    return;
+
+  // Lines from stdin go through the history, piped ones too; -c strings
+  // and scripts do not
+  char *expanded = NULL;
+  if (src->stream) {
+    switch (expand_history(line, &expanded)) {
+    case -1:
+      g_last_status = 1;
+      return;
+    case 1:
+      line = expanded;
+      printf("%s\n", line); // Show what is about to run
+      break;
+    }
+    add_to_history(line);
+  }
+
+  if (strstr(line, "<<")) {
+    // Reading the bodies reuses the line buffer; line is dead after this
+    ASTNode *ast = parse_input(&heredoc_arena, line);
+    if (!ast)
+      g_last_status = 2; // Syntax error
+    else if (collect_heredocs(ast, src) == 0)
+      execute_ast(ast);
+    arena_reset(&heredoc_arena);
+  } else {
+    // Repeated and recalled lines come straight from the cache
+    ASTNode *ast = ast_cache_get(line);
+    if (ast) {
+      execute_ast(ast);
+      ast_cache_release(ast);
+    } else
+      g_last_status = 2; // Syntax error
+  }
+  free(expanded);
+}
+
+void shell_loop(LineSource *src) {
+  arena_init(&heredoc_arena);
+
+  while (1) {
+    check_background_jobs();
+    if (g_interactive && !src->edit) {
+      display_prompt();
+      wait_for_input();
+    }
+
+    if (line_source_next(src) < 0) {
+      // This is now only reached on Ctrl-D (EOF) due to SA_RESTART
+      if (g_interactive)
+        printf("\n");
+      break; // Correctly exit the loop on EOF
+    }
+    run_line(src->line, src);
+    // The loop correctly continues to the next iteration from here.
+  }
+  arena_free(&heredoc_arena);
+}
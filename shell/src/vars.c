@@ -0,0 +1,447 @@
+#include "../include/vars.h"
+#include <ctype.h>
+
+#define VARS_INITIAL_BUCKETS 64
+#define VARS_INITIAL_ENV 64
+
+extern char **environ;
+
+typedef struct Var {
+  char *entry;     // "NAME=value"; also the envp string while exported
+  size_t name_len; // Value starts at entry + name_len + 1
+  long env_index;  // Slot in env while exported, otherwise -1
+  struct Var *next;
+} Var;
+
+struct VarSave {
+  char *name;
+  char *value; // Old value, NULL if it was unset
+  int exported;
+  struct VarSave *next;
+};
+
+static Var **buckets = NULL;
+static size_t bucket_count = 0;
+static size_t var_count = 0;
+static char **env = NULL; // NULL-terminated, in no particular order
+static size_t env_count = 0;
+static size_t env_cap = 0;
+static int initialized = 0;
+
+static void import_environ(void);
+
+// FNV-1a
+static size_t hash_name(const char *name, size_t len) {
+  size_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    h ^= (unsigned char)name[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static size_t name_length(const char *s) {
+  if (!(isalpha((unsigned char)s[0]) || s[0] == '_'))
+    return 0;
+  size_t n = 1;
+  while (isalnum((unsigned char)s[n]) || s[n] == '_')
+    n++;
+  return n;
+}
+
+static int valid_name(const char *name, size_t len) {
+  return len > 0 && name_length(name) == len;
+}
+
+size_t vars_assignment_name(const char *word, size_t len) {
+  size_t n = name_length(word);
+  return n > 0 && n < len && word[n] == '=' ? n : 0;
+}
+
+static Var **find_slot(const char *name, size_t len) {
+  Var **slot = &buckets[hash_name(name, len) & (bucket_count - 1)];
+  while (*slot && !((*slot)->name_len == len &&
+                    memcmp((*slot)->entry, name, len) == 0))
+    slot = &(*slot)->next;
+  return slot;
+}
+
+static Var *find_var(const char *name, size_t len) {
+  if (!initialized)
+    import_environ();
+  return bucket_count ? *find_slot(name, len) : NULL;
+}
+
+static int grow_table(void) {
+  size_t new_count = bucket_count ? bucket_count * 2 : VARS_INITIAL_BUCKETS;
+  Var **new_buckets = calloc(new_count, sizeof(Var *));
+  if (!new_buckets) {
+    perror("calloc");
+    return -1;
+  }
+  for (size_t i = 0; i < bucket_count; i++) {
+    Var *v = buckets[i];
+    while (v) {
+      Var *next = v->next;
+      size_t idx = hash_name(v->entry, v->name_len) & (new_count - 1);
+      v->next = new_buckets[idx];
+      new_buckets[idx] = v;
+      v = next;
+    }
+  }
+  free(buckets);
+  buckets = new_buckets;
+  bucket_count = new_count;
+  return 0;
+}
+
+static int env_append(Var *v) {
+  if (env_count + 2 > env_cap) {
+    size_t cap = env_cap ? env_cap * 2 : VARS_INITIAL_ENV;
+    char **grown = realloc(env, cap * sizeof(char *));
+    if (!grown) {
+      perror("realloc");
+      return -1;
+    }
+    env = grown;
+    env_cap = cap;
+  }
+  v->env_index = env_count;
+  env[env_count++] = v->entry;
+  env[env_count] = NULL;
+  return 0;
+}
+
+// Take v out of env by moving the last entry into its slot
+static void env_remove(Var *v) {
+  size_t idx = v->env_index;
+  size_t last = env_count - 1;
+  if (idx != last) {
+    env[idx] = env[last];
+    const char *moved = env[idx];
+    find_var(moved, strchr(moved, '=') - moved)->env_index = idx;
+  }
+  env[last] = NULL;
+  env_count--;
+  v->env_index = -1;
+}
+
+// libc's own $PATH searches (execvp, posix_spawnp) read the process
+// environment, so that copy of PATH follows the shell variable
+static void sync_process_env(const char *name, size_t len,
+                             const char *value) {
+  if (len != 4 || memcmp(name, "PATH", 4) != 0)
+    return;
+  if (value)
+    setenv("PATH", value, 1);
+  else
+    unsetenv("PATH");
+}
+
+static Var *set_var(const char *name, size_t len, const char *value,
+                    int export) {
+  if (!initialized)
+    import_environ();
+  size_t value_len = strlen(value);
+  char *entry = malloc(len + value_len + 2);
+  if (!entry) {
+    perror("malloc");
+    return NULL;
+  }
+  memcpy(entry, name, len);
+  entry[len] = '=';
+  memcpy(entry + len + 1, value, value_len + 1);
+
+  Var *v = bucket_count ? *find_slot(name, len) : NULL;
+  if (v) {
+    if (v->env_index >= 0)
+      env[v->env_index] = entry; // Swapped in place, nothing else moves
+    free(v->entry);
+    v->entry = entry;
+  } else {
+    if ((bucket_count == 0 || var_count >= bucket_count) &&
+        grow_table() != 0) {
+      free(entry);
+      return NULL;
+    }
+    v = malloc(sizeof(Var));
+    if (!v) {
+      perror("malloc");
+      free(entry);
+      return NULL;
+    }
+    v->entry = entry;
+    v->name_len = len;
+    v->env_index = -1;
+    Var **slot = find_slot(name, len);
+    v->next = *slot;
+    *slot = v;
+    var_count++;
+  }
+  if (export && v->env_index < 0 && env_append(v) != 0)
+    return NULL;
+  sync_process_env(name, len, value);
+  return v;
+}
+
+static void import_environ(void) {
+  initialized = 1;
+  for (char **e = environ; e && *e; e++) {
+    const char *eq = strchr(*e, '=');
+    if (eq)
+      set_var(*e, eq - *e, eq + 1, 1);
+  }
+}
+
+const char *vars_get(const char *name) {
+  Var *v = find_var(name, strlen(name));
+  return v ? v->entry + v->name_len + 1 : NULL;
+}
+
+int vars_export(const char *name, const char *value) {
+  size_t len = strlen(name);
+  if (!valid_name(name, len))
+    return -1;
+  if (value)
+    return set_var(name, len, value, 1) ? 0 : -1;
+  Var *v = find_var(name, len);
+  if (!v || v->env_index >= 0)
+    return 0;
+  return env_append(v);
+}
+
+void vars_unset(const char *name) {
+  size_t len = strlen(name);
+  if (!find_var(name, len))
+    return;
+  Var **slot = find_slot(name, len);
+  Var *v = *slot;
+  if (v->env_index >= 0)
+    env_remove(v);
+  *slot = v->next;
+  free(v->entry);
+  free(v);
+  var_count--;
+  sync_process_env(name, len, NULL);
+}
+
+int vars_assign(const char *assignment, int export) {
+  size_t len = vars_assignment_name(assignment, strlen(assignment));
+  if (len == 0)
+    return -1;
+  return set_var(assignment, len, assignment + len + 1, export) ? 0 : -1;
+}
+
+char **vars_environ(void) {
+  if (!initialized)
+    import_environ();
+  if (!env) {
+    static char *empty[] = {NULL};
+    return empty;
+  }
+  return env;
+}
+
+char **vars_environ_with(char **assigns, int count) {
+  char **base = vars_environ();
+  char **out = malloc((env_count + count + 1) * sizeof(char *));
+  if (!out) {
+    perror("malloc");
+    return NULL;
+  }
+  memcpy(out, base, env_count * sizeof(char *));
+  size_t n = env_count;
+  for (int i = 0; i < count; i++) {
+    size_t len = vars_assignment_name(assigns[i], strlen(assigns[i]));
+    if (len == 0)
+      continue;
+    // An exported variable already has its slot; anything else is new,
+    // unless an earlier assignment on the same command added it
+    Var *v = find_var(assigns[i], len);
+    size_t slot = v && v->env_index >= 0 ? (size_t)v->env_index : n;
+    for (size_t j = env_count; slot == n && j < n; j++) {
+      if (strncmp(out[j], assigns[i], len + 1) == 0)
+        slot = j;
+    }
+    out[slot] = assigns[i];
+    if (slot == n)
+      n++;
+  }
+  out[n] = NULL;
+  return out;
+}
+
+VarSave *vars_apply(char **assigns, int count) {
+  VarSave *save = NULL;
+  for (int i = 0; i < count; i++) {
+    size_t len = vars_assignment_name(assigns[i], strlen(assigns[i]));
+    VarSave *s = len ? calloc(1, sizeof(VarSave)) : NULL;
+    if (!s || !(s->name = strndup(assigns[i], len))) {
+      free(s);
+      continue;
+    }
+    Var *v = find_var(assigns[i], len);
+    if (v) {
+      s->value = strdup(v->entry + len + 1);
+      s->exported = v->env_index >= 0;
+    }
+    // Restored newest first, so a name given twice ends up as it was
+    s->next = save;
+    save = s;
+    set_var(assigns[i], len, assigns[i] + len + 1, 1);
+  }
+  return save;
+}
+
+void vars_restore(VarSave *save) {
+  while (save) {
+    VarSave *next = save->next;
+    if (!save->value) {
+      vars_unset(save->name);
+    } else {
+      Var *v = set_var(save->name, strlen(save->name), save->value, 0);
+      if (v && !save->exported && v->env_index >= 0)
+        env_remove(v);
+    }
+    free(save->name);
+    free(save->value);
+    free(save);
+    save = next;
+  }
+}
+
+static int compare_entries(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+void vars_print_exported(void) {
+  char **base = vars_environ();
+  char **sorted = malloc((env_count + 1) * sizeof(char *));
+  if (!sorted) {
+    perror("malloc");
+    return;
+  }
+  memcpy(sorted, base, env_count * sizeof(char *));
+  qsort(sorted, env_count, sizeof(char *), compare_entries);
+  for (size_t i = 0; i < env_count; i++)
+    printf("export %s\n", sorted[i]);
+  free(sorted);
+}
+
+// --- Expansion ---
+
+typedef struct {
+  char *data;
+  size_t len, cap;
+} Text;
+
+static int text_append(Text *t, const char *s, size_t n) {
+  if (t->len + n + 1 > t->cap) {
+    size_t cap = t->cap ? t->cap * 2 : 64;
+    while (cap < t->len + n + 1)
+      cap *= 2;
+    char *grown = realloc(t->data, cap);
+    if (!grown) {
+      perror("realloc");
+      return -1;
+    }
+    t->data = grown;
+    t->cap = cap;
+  }
+  memcpy(t->data + t->len, s, n);
+  t->len += n;
+  return 0;
+}
+
+char *vars_expand(Arena *arena, const char *word) {
+  Text t = {0};
+  char number[24];
+  const char *p = word;
+  int ok = 0;
+  while (*p) {
+    const char *dollar = strchr(p, '$');
+    if (dollar != p) {
+      size_t n = dollar ? (size_t)(dollar - p) : strlen(p);
+      if (text_append(&t, p, n) != 0)
+        goto out;
+      p += n;
+      continue;
+    }
+
+    const char *value = NULL;
+    size_t n;
+    if (p[1] == '?' || p[1] == '$') {
+      snprintf(number, sizeof(number), "%ld",
+               p[1] == '?' ? (long)g_last_status : (long)getpid());
+      value = number;
+      p += 2;
+    } else if (p[1] == '{' && (n = name_length(p + 2)) > 0 &&
+               p[2 + n] == '}') {
+      Var *v = find_var(p + 2, n);
+      value = v ? v->entry + n + 1 : NULL;
+      p += n + 3;
+    } else if ((n = name_length(p + 1)) > 0) {
+      Var *v = find_var(p + 1, n);
+      value = v ? v->entry + n + 1 : NULL;
+      p += n + 1;
+    } else {
+      value = "$"; // Nothing to expand, keep it literally
+      p++;
+    }
+    if (value && text_append(&t, value, strlen(value)) != 0)
+      goto out;
+  }
+  ok = 1;
+out:;
+  char *result = ok ? arena_strndup(arena, t.data ? t.data : "", t.len) : NULL;
+  free(t.data);
+  return result;
+}
+
+// word, expanded only if it refers to something
+static char *expand_word(Arena *arena, char *word) {
+  return strchr(word, '$') ? vars_expand(arena, word) : word;
+}
+
+CommandNode *vars_expand_command(Arena *arena, CommandNode *cmd) {
+  if (!cmd->expand)
+    return cmd;
+  CommandNode *copy = arena_alloc(arena, sizeof(*copy));
+  if (!copy)
+    return NULL;
+  *copy = *cmd;
+  copy->expand = 0;
+  copy->args = arena_calloc(arena, cmd->arg_count + 1, sizeof(char *));
+  copy->assigns = arena_calloc(arena, cmd->assign_count + 1, sizeof(char *));
+  if (!copy->args || !copy->assigns)
+    return NULL;
+
+  copy->arg_count = 0;
+  for (int i = 0; i < cmd->arg_count; i++) {
+    char *arg = expand_word(arena, cmd->args[i]);
+    if (!arg)
+      return NULL;
+    if (*arg) // Without quoting an empty word could never be meant
+      copy->args[copy->arg_count++] = arg;
+  }
+  for (int i = 0; i < cmd->assign_count; i++) {
+    if (!(copy->assigns[i] = expand_word(arena, cmd->assigns[i])))
+      return NULL;
+  }
+
+  Redirection **link = &copy->redirections;
+  for (const Redirection *r = cmd->redirections; r; r = r->next) {
+    Redirection *rc = arena_alloc(arena, sizeof(*rc));
+    if (!rc)
+      return NULL;
+    *rc = *r;
+    // A here-document delimiter is matched as written
+    if (r->type != REDIR_HEREDOC &&
+        !(rc->filename = expand_word(arena, r->filename)))
+      return NULL;
+    rc->next = NULL;
+    *link = rc;
+    link = &rc->next;
+  }
+  return copy;
+}